@@ -2,6 +2,16 @@
 #define CORE_H
 
 #define PCP_SAMPLE_RULE_UNIFORM 0x00
+#define PCP_SAMPLE_RULE_FPS     0x01
+#define PCP_SAMPLE_RULE_POISSON 0x02
+// color kept for a duplicated point: its first occurrence's, or the
+// mean of all of them
+#define PCP_DEDUP_KEEP_FIRST    0x00
+#define PCP_DEDUP_AVERAGE       0x01
+// color of a voxel holding several points: the mean or the median
+// of theirs, channel by channel
+#define PCP_VOXEL_AVERAGE       0x00
+#define PCP_VOXEL_MEDIAN        0x01
 #define PCP_FLOAT_ERROR         1e-6f
 
 #if defined(WITH_GLFW) && defined(WITH_GL) && defined(WITH_GLEW)
@@ -10,6 +20,7 @@
 
 #include "pcprep/pcprep_export.h"
 #include <png.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 typedef struct
@@ -21,17 +32,49 @@ typedef struct
 PCPREP_EXPORT
 long long get_current_time_ms(void);
 
+// Number of threads the parallel routines of the library may use,
+// the number of online processors unless set by set_thread_count.
+PCPREP_EXPORT
+int get_thread_count(void);
+// `count` <= 0 restores the default.
+PCPREP_EXPORT
+void set_thread_count(int count);
+
 PCPREP_EXPORT
 int float_error(float a, float b, float e);
 
 PCPREP_EXPORT
 int float_equal(float a, float b);
 
+// Counter-based random numbers: the `counter`-th draw of the stream
+// of `seed`, so draws can be made in any order or in parallel.
+PCPREP_EXPORT
+uint64_t random_u64(uint64_t seed, uint64_t counter);
+// Uniform in [0, bound), `bound` > 0.
+PCPREP_EXPORT
+uint64_t random_below(uint64_t seed,
+                      uint64_t counter,
+                      uint64_t bound);
+// Uniform in [0, 1).
+PCPREP_EXPORT
+double   random_unit(uint64_t seed, uint64_t counter);
+
+// Draws `k` distinct indices of [0, n) into `out`, in increasing
+// order, reproducibly from `seed`. Small samples use Floyd's
+// algorithm, large ones sequential skips (Vitter's algorithm A), so
+// at most O(k) memory is used. Returns k, or -1 if k > n or memory
+// runs out.
+PCPREP_EXPORT
+int sample_indices(uint64_t seed, size_t n, size_t k, size_t *out);
+
+// Copies `output_size` distinct elements of `input`, in input order,
+// drawn from `seed`. Returns -1 if `output_size` > `input_size`.
 PCPREP_EXPORT
-int sample_union(int *input,
-                 int  input_size,
-                 int *output,
-                 int  output_size);
+int sample_union(int     *input,
+                 int      input_size,
+                 int     *output,
+                 int      output_size,
+                 uint64_t seed);
 
 PCPREP_EXPORT
 float quantize(float x, float q);
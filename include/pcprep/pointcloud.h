@@ -6,27 +6,148 @@ extern "C"
 {
 #endif
 
+#include "pcprep/aabb.h"
 #include "pcprep/pcprep_export.h"
 #include "pcprep/vec3f.h"
 #include <stdint.h>
 #include <stdlib.h>
 
+// properties of the points to load, see pointcloud_load_props
+#define PCP_PROP_POS 0x01
+#define PCP_PROP_RGB 0x02
+#define PCP_PROP_ALL (PCP_PROP_POS | PCP_PROP_RGB)
+// alignment, in floats, of the arrays of a pointcloud_soa_t and the
+// multiple of their padded length (one 64-byte cache line)
+#define PCP_SOA_WIDTH 16
+
+  typedef struct pointcloud_arena_t pointcloud_arena_t;
   typedef struct pointcloud_t
+  {
+    float              *pos;
+    uint8_t            *rgb;
+    // number of points, *pos have size*3 elements
+    size_t              size;
+    // file mapping that `pos` and `rgb` point into, NULL when they
+    // are allocated on the heap
+    void               *map;
+    size_t              map_size;
+    // arena that `pos` and `rgb` are carved from, which owns them
+    pointcloud_arena_t *arena;
+    // set when `pos` and `rgb` point into the storage of another
+    // cloud, see pointcloud_partition
+    int                 view;
+    // bounds of the points, valid when `has_bounds` is set
+    aabb_t              bounds;
+    int                 has_bounds;
+  } pointcloud_t;
+  // One block of positions and one of colors shared by many clouds,
+  // e.g. the tiles of a frame, which are handed out by offset. The
+  // clouds are released all at once by resetting or freeing the
+  // arena; `pointcloud_free` on one of them only clears it.
+  struct pointcloud_arena_t
   {
     float   *pos;
     uint8_t *rgb;
-    size_t   size; // number of points, *pos have size*3 elements
-  } pointcloud_t;
+    size_t   capacity; // in points
+    size_t   used;
+  };
+  // Structure-of-arrays layout of a cloud for the vectorized kernels
+  // below. `x`, `y` and `z` are 64-byte aligned and hold `size`
+  // coordinates, padded with copies of the last point up to a
+  // multiple of PCP_SOA_WIDTH, so that loops need no remainder.
+  typedef struct pointcloud_soa_t
+  {
+    float   *x;
+    float   *y;
+    float   *z;
+    uint8_t *rgb; // interleaved like in pointcloud_t, may be NULL
+    size_t   size;
+  } pointcloud_soa_t;
   // this need reference
   PCPREP_EXPORT
   int pointcloud_init(pointcloud_t *pc, size_t size);
   // this need reference
   PCPREP_EXPORT
   int pointcloud_free(pointcloud_t *pc);
-  // this need reference
+  // Gzip-compressed PLY files are inflated on a background thread
+  // while they are parsed.
   PCPREP_EXPORT
   int pointcloud_load(pointcloud_t *pc, const char *filename);
-  // this doesn't need reference
+  // Loads only the properties in the PCP_PROP_* mask `props`. Without
+  // PCP_PROP_RGB, colors are neither parsed nor allocated and
+  // `pc->rgb` is NULL (except for mapped PCB files). Tiling and
+  // merging keep such clouds color-less; writing them fails.
+  PCPREP_EXPORT
+  int pointcloud_load_props(pointcloud_t *pc,
+                            const char   *filename,
+                            unsigned      props);
+  // Reads a cloud in chunks of bounded size instead of all at once.
+  typedef struct pointcloud_stream_t pointcloud_stream_t;
+  // returns NULL if the file can't be opened or its header is invalid
+  PCPREP_EXPORT
+  pointcloud_stream_t *pointcloud_stream_open(const char *filename);
+  // total number of points in the stream
+  PCPREP_EXPORT
+  size_t pointcloud_stream_size(pointcloud_stream_t *stream);
+  // Replaces the content of `chunk` with the next `max_points` points
+  // at most. `chunk` must be zero-initialized or hold a previous
+  // chunk, whose buffers are reused. Returns the number of points
+  // read, 0 at the end of the stream or -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_stream_next_chunk(pointcloud_stream_t *stream,
+                                   size_t               max_points,
+                                   pointcloud_t        *chunk);
+  PCPREP_EXPORT
+  void pointcloud_stream_close(pointcloud_stream_t *stream);
+  // Writes `pc` as a PLY file whose positions are `bits`-bit integers
+  // (1 to 24) spanning the bounding box of `pc`, e.g. 16 bits for
+  // half the size of float positions. The offset and scale are stored
+  // in a header comment, from which `pointcloud_load` restores the
+  // coordinates. Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_write_quantized(pointcloud_t pc,
+                                 const char  *filename,
+                                 int          binary,
+                                 int          bits);
+  // Saves `pc` in the native PCB format: a 64-byte header holding the
+  // point count and bounding box, then the positions and the colors
+  // as two 64-byte aligned blocks laid out like `pos` and `rgb`. A
+  // cloud without colors is saved with black ones.
+  // Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_save_pcb(pointcloud_t pc, const char *filename);
+  // Maps a PCB file into memory copy-on-write, pointing `pc->pos` and
+  // `pc->rgb` into the mapping, and sets `aabb` (if not NULL) to the
+  // stored bounding box. `pointcloud_free` releases the mapping.
+  // Returns 1 on success, 0 on error, like `pointcloud_load`, which
+  // also maps PCB files.
+  PCPREP_EXPORT
+  int pointcloud_map_pcb(pointcloud_t *pc,
+                         const char   *filename,
+                         aabb_t       *aabb);
+  // Saves `count` tiles into one PCT container: a directory with the
+  // id, bounding box, point count and data offsets of every tile,
+  // then the tiles' data laid out like PCB files. The tiles are
+  // written concurrently at precomputed offsets.
+  // Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_save_tiles(const pointcloud_t *tiles,
+                            int                 count,
+                            const char         *filename);
+  // Returns the number of tiles in a PCT container, or -1 if
+  // `filename` isn't one.
+  PCPREP_EXPORT
+  int pointcloud_count_tiles(const char *filename);
+  // Maps only tile `tile` of a PCT container, like
+  // `pointcloud_map_pcb` does with a whole file.
+  // Returns 1 on success, 0 on error.
+  PCPREP_EXPORT
+  int pointcloud_map_tile(pointcloud_t *pc,
+                          const char   *filename,
+                          int           tile,
+                          aabb_t       *aabb);
+  // If `filename` ends in ".gz", the file is gzip-compressed on a
+  // background thread while it is written.
   PCPREP_EXPORT
   int pointcloud_write(pointcloud_t pc,
                        const char  *filename,
@@ -37,8 +158,49 @@ extern "C"
   // this doesn't need reference
   PCPREP_EXPORT
   int pointcloud_max(pointcloud_t pc, vec3f_t *max);
+  // Bounds of the points, from the cache of `pc` if it has them, or
+  // else found in one parallel pass and cached. Functions that change
+  // the positions of a cloud drop its cache; code that changes them
+  // directly must call pointcloud_invalidate_bounds.
+  // `pointcloud_min`, `pointcloud_max`, and the functions that bucket
+  // points by their bounds don't trust the cache and find them again.
+  // Returns 0 on success, -1 if the cloud is empty.
+  PCPREP_EXPORT
+  int pointcloud_bounds(pointcloud_t *pc, aabb_t *aabb);
+  PCPREP_EXPORT
+  int pointcloud_invalidate_bounds(pointcloud_t *pc);
   PCPREP_EXPORT
   int get_tile_id(vec3f_t n, vec3f_t min, vec3f_t max, vec3f_t v);
+  // Allocates `soa` for `size` points, without colors.
+  // Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_soa_init(pointcloud_soa_t *soa, size_t size);
+  PCPREP_EXPORT
+  int pointcloud_soa_free(pointcloud_soa_t *soa);
+  // Allocates `soa` and copies `pc` into it, colors included if any.
+  // Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_to_soa(pointcloud_t pc, pointcloud_soa_t *soa);
+  // Allocates `pc` and copies `soa` back into it.
+  // Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_from_soa(pointcloud_soa_t soa, pointcloud_t *pc);
+  // Same as `pointcloud_min` and `pointcloud_max` together.
+  PCPREP_EXPORT
+  int pointcloud_soa_bounds(pointcloud_soa_t soa, aabb_t *aabb);
+  // Stores `get_tile_id(n, aabb.min, aabb.max, p)` of every point p
+  // into `ids`, which holds `soa.size` ints.
+  PCPREP_EXPORT
+  int pointcloud_soa_tile_ids(pointcloud_soa_t soa,
+                              vec3f_t          n,
+                              aabb_t           aabb,
+                              int             *ids);
+  // Stores `vec3f_mvp_mul(p, mvp)` of every point p into `ndc`, which
+  // must be initialized for at least `soa.size` points.
+  PCPREP_EXPORT
+  int pointcloud_soa_project(pointcloud_soa_t  soa,
+                             const float      *mvp,
+                             pointcloud_soa_t *ndc);
   // this doesn't need reference
   // `tiles` should be passed as a reference of a pointcloud_t*
   PCPREP_EXPORT
@@ -47,6 +209,63 @@ extern "C"
                       int            n_y,
                       int            n_z,
                       pointcloud_t **tiles);
+  // Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_arena_init(pointcloud_arena_t *arena,
+                            size_t              capacity);
+  // Releases every cloud of the arena at once and grows it to hold at
+  // least `capacity` points, keeping its memory for reuse.
+  // Returns 0 on success, -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_arena_reset(pointcloud_arena_t *arena,
+                             size_t              capacity);
+  PCPREP_EXPORT
+  int pointcloud_arena_free(pointcloud_arena_t *arena);
+  // Points `pc` at the next `size` free points of the arena.
+  // Returns 0 on success, -1 if the arena is full.
+  PCPREP_EXPORT
+  int pointcloud_arena_alloc(pointcloud_arena_t *arena,
+                             size_t              size,
+                             pointcloud_t       *pc);
+  // Same as `pointcloud_tile`, but the tiles are laid out one after
+  // the other in `arena`, which is reset first, instead of having
+  // their own allocations.
+  PCPREP_EXPORT
+  int pointcloud_tile_arena(pointcloud_t        pc,
+                            int                 n_x,
+                            int                 n_y,
+                            int                 n_z,
+                            pointcloud_arena_t *arena,
+                            pointcloud_t      **tiles);
+  // Same tiles as `pointcloud_tile` without copying any point: `pc`
+  // is reordered in place so that the points of every tile are
+  // contiguous, and `*tiles` are views into it, valid as long as
+  // `pc` is. The order of the points within a tile isn't kept.
+  // `aabbs`, if not NULL, receives the bounds of every tile.
+  // Returns the number of tiles, or -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_partition(pointcloud_t  *pc,
+                           int            n_x,
+                           int            n_y,
+                           int            n_z,
+                           pointcloud_t **tiles,
+                           aabb_t        *aabbs);
+  // Tiles the cloud in `filename` into n_x * n_y * n_z files named
+  // after the printf pattern `output_path`, `chunk_points` points at
+  // a time, so that memory use doesn't depend on the cloud size. The
+  // grid spans `aabb`, or the bounds of the cloud found in a first
+  // pass if it is NULL; points outside it are dropped. The tiles
+  // can't be gzip-compressed, their headers are patched at the end.
+  // Returns the number of tiles or -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_tile_stream(const char   *filename,
+                             int           n_x,
+                             int           n_y,
+                             int           n_z,
+                             const aabb_t *aabb,
+                             size_t        chunk_points,
+                             const char   *output_path,
+                             int           binary);
   // `pcs` should be passed as an array of pointcloud_t
   // `output` should be passed as a reference to a pointcloud_t
   PCPREP_EXPORT
@@ -54,26 +273,48 @@ extern "C"
                        size_t        pc_count,
                        pointcloud_t *out);
   // `output` should be passed as a reference to a pointcloud_t
+  // Keeps `ratio` of the points, the same ones for the same `seed`.
+  // PCP_SAMPLE_RULE_UNIFORM keeps them in their order,
+  // PCP_SAMPLE_RULE_FPS in farthest point order from a point drawn
+  // at random. PCP_SAMPLE_RULE_POISSON keeps about `ratio` of them
+  // in their order, with the spacing of pointcloud_sample_poisson
+  // found for it. Returns the number of points kept, or -1 on error.
+  PCPREP_EXPORT
+  int pointcloud_sample(pointcloud_t  pc,
+                        float         ratio,
+                        unsigned char strategy,
+                        uint64_t      seed,
+                        pointcloud_t *out);
+  // `output` should be passed as a reference to a pointcloud_t
+  // Keeps points of `pc` in their order, no two of them nearer than
+  // `radius`, tried in a random order drawn from `seed`. Returns the
+  // number of points kept, or -1 if `radius` is not positive or
+  // splits the cloud into over 2^24 cells along an axis.
   PCPREP_EXPORT
-  int         pointcloud_sample(pointcloud_t  pc,
-                                float         ratio,
-                                unsigned char strategy,
+  int pointcloud_sample_poisson(pointcloud_t  pc,
+                                float         radius,
+                                uint64_t      seed,
                                 pointcloud_t *out);
 
-  static void pointcloud_element_merge(pointcloud_t pc,
-                                       int          left,
-                                       int          mid,
-                                       int          right);
-  static void
-  pointcloud_element_merge_sort(pointcloud_t pc, int left, int right);
   // `output` should be passed as a reference to a pointcloud_t
+  // The unique points come out sorted by x, then y, then z; `pc` is
+  // left untouched. `policy` picks the color of a point found more
+  // than once, see PCP_DEDUP_KEEP_FIRST and PCP_DEDUP_AVERAGE.
+  // Returns the number of unique points, or -1 on error.
   PCPREP_EXPORT
   int pointcloud_remove_dupplicates(pointcloud_t  pc,
+                                    unsigned char policy,
                                     pointcloud_t *out);
   // `output` should be passed as a reference to a pointcloud_t
+  // Keeps one point per occupied voxel of the grid of step
+  // `voxel_size`, at the voxel's position, sorted by x, y, z.
+  // `policy` picks how the colors of a voxel's points are merged, see
+  // PCP_VOXEL_AVERAGE and PCP_VOXEL_MEDIAN. Returns the number of
+  // voxels, or -1 on error.
   PCPREP_EXPORT
   int pointcloud_voxel(pointcloud_t  pc,
                        float         voxel_size,
+                       unsigned char policy,
                        pointcloud_t *out);
   PCPREP_EXPORT
   int pointcloud_count_pixel_per_tile(pointcloud_t pc,
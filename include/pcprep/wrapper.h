@@ -20,6 +20,42 @@ extern "C"
   PCPREP_EXPORT
   int ply_mesh_loader(const char *filename, float *pos, int *indices);
 
+  // A PLY file whose header has been parsed once. Element counts can
+  // be queried before allocating, then the body is loaded from the
+  // same open file. Each handle can be loaded from only once.
+  typedef struct ply_reader_t ply_reader_t;
+  // returns NULL if the file can't be opened or its header is invalid
+  PCPREP_EXPORT
+  ply_reader_t *ply_reader_open(const char *filename);
+  PCPREP_EXPORT
+  int ply_reader_count_vertex(ply_reader_t *reader);
+  PCPREP_EXPORT
+  int ply_reader_count_face(ply_reader_t *reader);
+  PCPREP_EXPORT
+  int ply_reader_load_pointcloud(ply_reader_t  *reader,
+                                 float         *pos,
+                                 unsigned char *rgb);
+  PCPREP_EXPORT
+  int ply_reader_load_mesh(ply_reader_t *reader,
+                           float        *pos,
+                           int          *indices);
+  // Reads the next `max_points` vertices at most, so that clouds can
+  // be consumed in chunks. Can't be mixed with the load functions.
+  // Returns the number of vertices read, 0 at the end of the vertex
+  // element or -1 on error.
+  PCPREP_EXPORT
+  int ply_reader_read_points(ply_reader_t  *reader,
+                             size_t         max_points,
+                             float         *pos,
+                             unsigned char *rgb);
+  // header comments, without the `comment` keyword
+  PCPREP_EXPORT
+  int ply_reader_count_comment(ply_reader_t *reader);
+  PCPREP_EXPORT
+  const char *ply_reader_comment(ply_reader_t *reader, int index);
+  PCPREP_EXPORT
+  void ply_reader_close(ply_reader_t *reader);
+
 #ifdef __cplusplus
 }
 #endif
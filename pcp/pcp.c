@@ -4,80 +4,328 @@
 #include <pcprep/core.h>
 #include <pcprep/pointcloud.h>
 #include <pcprep/wrapper.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-int pcp_prepare(struct arguments *arg)
+typedef struct pcp_load_pool_t
+{
+  pointcloud_t   *pcs;
+  int             count;
+  int             next;
+  const char     *input_path;
+  int             frame;
+  int             framed;
+  int             container;
+  unsigned int    props;
+  pthread_mutex_t lock;
+} pcp_load_pool_t;
+
+typedef struct pcp_write_pool_t
+{
+  pointcloud_t   *pcs;
+  int             count;
+  int             next;
+  const char     *output_path;
+  int             binary;
+  unsigned char   format;
+  int             quantize;
+  int             frame;
+  int             framed;
+  long long      *latency;
+  pthread_mutex_t lock;
+} pcp_write_pool_t;
+
+// Runs `worker` on `threads` threads, the calling one included, and
+// returns once they are all done.
+static void
+pcp_run_workers(void *(*worker)(void *), void *ctx, int threads)
+{
+  pthread_t *ids     = NULL;
+  int        started = 0;
+  if (threads > 1)
+    ids = (pthread_t *)malloc(sizeof(pthread_t) * (threads - 1));
+  for (int i = 1; ids && i < threads; i++)
+  {
+    if (pthread_create(&ids[started], NULL, worker, ctx) != 0)
+      break;
+    started++;
+  }
+  worker(ctx);
+  for (int i = 0; i < started; i++)
+    pthread_join(ids[i], NULL);
+  free(ids);
+}
+
+// Takes the next unread input tile until there are none left.
+static void *pcp_load_worker(void *arg)
+{
+  pcp_load_pool_t *pool = (pcp_load_pool_t *)arg;
+  char             path[SIZE_PATH];
+  while (1)
+  {
+    pthread_mutex_lock(&pool->lock);
+    int t = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (t >= pool->count)
+      break;
+
+    if (pool->framed)
+      snprintf(path, SIZE_PATH, pool->input_path, pool->frame, t);
+    else
+      snprintf(path, SIZE_PATH, pool->input_path, t);
+    if (pool->container)
+      pointcloud_map_tile(&pool->pcs[t], path, t, NULL);
+    else
+      pointcloud_load_props(&pool->pcs[t], path, pool->props);
+  }
+  return NULL;
+}
+
+// Takes the next unwritten tile until there are none left. Each tile
+// is released once written, so at most one tile per worker is in
+// flight on top of the tiles still waiting.
+static void *pcp_write_worker(void *arg)
 {
-  pointcloud_t *in_pcs           = NULL;
-  pointcloud_t *proc_pcs         = NULL;
-  pointcloud_t *out_pcs          = NULL;
-  char         *input_path       = NULL;
-  char         *output_path      = NULL;
-  char         *output_tile_path = NULL;
-  char         *input_tile_path  = NULL;
-  int           max_path_size    = 0;
-  int           binary           = 0;
-  int           proc_count       = 0;
-  int           in_count         = 0;
-  int           out_count        = 0;
-  long long     read_time        = 0;
-  long long     pre_proc_time    = 0;
-  long long     proc_time        = 0;
-  long long     post_proc_time   = 0;
-  long long     write_time       = 0;
-  long long     curr_time        = 0;
-
-  max_path_size                  = SIZE_PATH;
-  input_path                     = arg->input;
-  output_path                    = arg->output;
-  binary                         = arg->binary;
-  input_tile_path  = (char *)malloc(max_path_size * sizeof(char));
-  output_tile_path = (char *)malloc(max_path_size * sizeof(char));
-  in_count         = arg->tiled_input;
-
-  curr_time        = get_current_time_ms();
-
-  in_pcs = (pointcloud_t *)calloc(in_count, sizeof(pointcloud_t));
-  for (int t = 0; t < in_count; t++)
-  {
-    snprintf(input_tile_path, max_path_size, input_path, t);
-    pointcloud_load(&in_pcs[t], input_tile_path);
-  }
-  read_time = get_current_time_ms() - curr_time;
+  pcp_write_pool_t *pool = (pcp_write_pool_t *)arg;
+  char              tile_path[SIZE_PATH];
+  while (1)
+  {
+    pthread_mutex_lock(&pool->lock);
+    int t = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    if (t >= pool->count)
+      break;
+
+    if (pool->pcs[t].size == 0)
+    {
+      printf("Tile %d have no points, skip writing...\n", t);
+    }
+    long long start = get_current_time_ms();
+    if (pool->framed)
+      snprintf(
+          tile_path, SIZE_PATH, pool->output_path, pool->frame, t);
+    else
+      snprintf(tile_path, SIZE_PATH, pool->output_path, t);
+    if (pool->format == PCP_FORMAT_PCB)
+      pointcloud_save_pcb(pool->pcs[t], tile_path);
+    else if (pool->quantize > 0)
+      pointcloud_write_quantized(
+          pool->pcs[t], tile_path, pool->binary, pool->quantize);
+    else
+      pointcloud_write(pool->pcs[t], tile_path, pool->binary);
+    pool->latency[t] = get_current_time_ms() - start;
+    pointcloud_free(&pool->pcs[t]);
+  }
+  return NULL;
+}
+
+// Writes `count` tiles with `arg->io_threads` concurrent writers and
+// prints how long each tile took. The output pattern gets the tile
+// index, after `frame` with --frames, except for a PCT container,
+// which holds every tile and only gets `frame`.
+int pcp_write_tiles(struct arguments *arg,
+                    pointcloud_t     *pcs,
+                    int               count,
+                    int               frame)
+{
+  pcp_write_pool_t pool       = {.pcs         = pcs,
+                                 .count       = count,
+                                 .next        = 0,
+                                 .output_path = arg->output,
+                                 .binary      = arg->binary,
+                                 .format      = arg->format,
+                                 .quantize    = arg->quantize,
+                                 .frame       = frame};
+  int              io_threads = arg->io_threads;
+
+  // without -o, the run only reports statuses
+  if (!arg->output)
+  {
+    for (int t = 0; t < count; t++)
+      pointcloud_free(&pcs[t]);
+    return 0;
+  }
+  if (arg->format == PCP_FORMAT_PCT)
+  {
+    char      path[SIZE_PATH];
+    long long start = get_current_time_ms();
+    snprintf(path, SIZE_PATH, arg->output, frame);
+    if (pointcloud_save_tiles(pcs, count, path) < 0)
+      fprintf(stderr, "Failed to write %s\n", path);
+    printf("container write time:\t%lld ms\n",
+           get_current_time_ms() - start);
+    for (int t = 0; t < count; t++)
+      pointcloud_free(&pcs[t]);
+    return count;
+  }
+  if (io_threads > count)
+    io_threads = count;
+  if (io_threads < 1)
+    io_threads = 1;
+  pool.framed  = arg->frames_count > 0;
+  pool.latency = (long long *)calloc(count, sizeof(long long));
+  if (!pool.latency)
+    return -1;
+  pthread_mutex_init(&pool.lock, NULL);
+  pcp_run_workers(pcp_write_worker, &pool, io_threads);
+  pthread_mutex_destroy(&pool.lock);
+
+  for (int t = 0; t < count; t++)
+    printf("tile %d write time:\t%lld ms\n", t, pool.latency[t]);
+  free(pool.latency);
+  return count;
+}
+
+// Tiles the input `arg->stream` points at a time, writing the tiles
+// as it goes instead of holding the cloud and its tiles in memory.
+int pcp_prepare_stream(struct arguments *arg)
+{
+  long long curr_time = 0;
+  int       count     = 0;
+
+  if (arg->tiled_input != 1 || !(arg->plan & PCP_PLAN_TILE_NONE) ||
+      arg->plan & (PCP_PLAN_NONE_TILE | PCP_PLAN_NONE_MERGE) ||
+      arg->flags & (SET_OPT_PROCESS | SET_OPT_STATUS) ||
+      arg->format != PCP_FORMAT_PLY || arg->quantize > 0 ||
+      !arg->output)
+  {
+    fprintf(stderr,
+            "--stream only supports --pre-process=TILE on a single "
+            "input to PLY, without process, status, post-process "
+            "or quantization, to an output\n");
+    return 0;
+  }
+
   curr_time = get_current_time_ms();
+  count     = pointcloud_tile_stream(arg->input,
+                                 arg->tile.nx,
+                                 arg->tile.ny,
+                                 arg->tile.nz,
+                                 arg->aabb,
+                                 arg->stream,
+                                 arg->output,
+                                 arg->binary);
+  if (count < 0)
+  {
+    fprintf(stderr, "Failed to tile %s\n", arg->input);
+    return 0;
+  }
+  printf("stream tile time:\t%lld ms\n",
+         get_current_time_ms() - curr_time);
+  return count;
+}
+
+// Properties the run needs from its input: colors are only read when
+// they are written out, processed, or rendered.
+static unsigned int pcp_props(struct arguments *arg)
+{
+  if (arg->output || arg->flags & SET_OPT_PROCESS)
+    return PCP_PROP_ALL;
+#ifdef PCP_STAT_SAVE_VIEWPORT
+  for (size_t i = 0; i < arg->stats_size; i++)
+    if (arg->stats[i].func_id == PCP_STAT_SAVE_VIEWPORT)
+      return PCP_PROP_ALL;
+#endif
+  return PCP_PROP_POS;
+}
+
+// Loads the input of `frame`: one cloud, or `arg->tiled_input` tiles
+// read concurrently by up to get_thread_count() threads. With
+// --frames, the frame number is the first argument of the input
+// pattern and the tile index the second.
+int pcp_load(struct arguments *arg, int frame, pointcloud_t **pcs)
+{
+  char            path[SIZE_PATH];
+  int             in_count = arg->tiled_input;
+  int             threads  = get_thread_count();
+  pcp_load_pool_t pool     = {.count      = in_count,
+                              .next       = 0,
+                              .input_path = arg->input,
+                              .frame      = frame,
+                              .framed     = arg->frames_count > 0,
+                              .props      = pcp_props(arg)};
+
+  *pcs     = (pointcloud_t *)calloc(in_count, sizeof(pointcloud_t));
+  pool.pcs = *pcs;
+  // a PCT input holds all the tiles, which are mapped one by one
+  snprintf(path, SIZE_PATH, arg->input, frame, 0);
+  if (!pool.framed)
+    snprintf(path, SIZE_PATH, arg->input, 0);
+  pool.container = pointcloud_count_tiles(path) >= 0;
+  if (threads > in_count)
+    threads = in_count;
+  pthread_mutex_init(&pool.lock, NULL);
+  pcp_run_workers(pcp_load_worker, &pool, threads);
+  pthread_mutex_destroy(&pool.lock);
+  return in_count;
+}
+
+// Tiles `pc`, which is consumed, into the storage of `arena`, which
+// only grows when a cloud doesn't fit, so frames stop allocating
+// once it has. A view is copied out first, as resetting the arena
+// would overwrite it while it is read.
+static int pcp_tile(struct arguments   *arg,
+                    pointcloud_t       *pc,
+                    pointcloud_arena_t *arena,
+                    pointcloud_t      **tiles)
+{
+  int nx    = arg->tile.nx;
+  int ny    = arg->tile.ny;
+  int nz    = arg->tile.nz;
+  int count = 0;
+  if (pc->view || pc->arena)
+  {
+    pointcloud_t copy = {0};
+    if (pointcloud_merge(pc, 1, &copy) < 0)
+    {
+      pointcloud_free(pc);
+      return -1;
+    }
+    pointcloud_free(pc);
+    *pc = copy;
+  }
+  count = pointcloud_tile_arena(*pc, nx, ny, nz, arena, tiles);
+  pointcloud_free(pc);
+  return count;
+}
+
+int pcp_pre_process(struct arguments   *arg,
+                    pointcloud_t      **pcs,
+                    int                 count,
+                    pointcloud_arena_t *arena)
+{
+  pointcloud_t *in_pcs     = *pcs;
+  pointcloud_t *proc_pcs   = NULL;
+  int           proc_count = 0;
   // this only run if in_count = 1
-  if (in_count == 1 && arg->plan & PCP_PLAN_TILE_NONE)
-  {
-    int nx     = 0;
-    int ny     = 0;
-    int nz     = 0;
-    nx         = arg->tile.nx;
-    ny         = arg->tile.ny;
-    nz         = arg->tile.nz;
-    proc_count = pointcloud_tile(in_pcs[0], nx, ny, nz, &proc_pcs);
-    for (int i = 0; i < in_count; i++)
-      pointcloud_free(&in_pcs[i]);
+  if (count == 1 && arg->plan & PCP_PLAN_TILE_NONE)
+  {
+    proc_count = pcp_tile(arg, &in_pcs[0], arena, &proc_pcs);
     free(in_pcs);
   }
-  else if (in_count > 1 && arg->plan & PCP_PLAN_MERGE_NONE)
+  else if (count > 1 && arg->plan & PCP_PLAN_MERGE_NONE)
   {
     proc_pcs   = (pointcloud_t *)malloc(sizeof(pointcloud_t));
-    proc_count = pointcloud_merge(in_pcs, in_count, &proc_pcs[0]);
-    for (int i = 0; i < in_count; i++)
+    proc_count = pointcloud_merge(in_pcs, count, &proc_pcs[0]);
+    for (int i = 0; i < count; i++)
       pointcloud_free(&in_pcs[i]);
     free(in_pcs);
   }
   else
   {
     proc_pcs   = in_pcs;
-    proc_count = in_count;
+    proc_count = count;
   }
+  *pcs = proc_pcs;
+  return proc_count;
+}
 
-  pre_proc_time = get_current_time_ms() - curr_time;
-
+// Builds the process and status legs from the options, once per run.
+void pcp_legs_setup(struct arguments *arg)
+{
   if (arg->flags & SET_OPT_PROCESS)
   {
     // Handle the SET_OPT_PROCESS flag
@@ -90,26 +338,39 @@ int pcp_prepare(struct arguments *arg)
       {
         pcp_sample_p_arg_t *param =
             (pcp_sample_p_arg_t *)malloc(sizeof(pcp_sample_p_arg_t));
-        *param = (pcp_sample_p_arg_t){1.0f, 0};
+        *param = (pcp_sample_p_arg_t){1.0f, 0, 0};
         assert(curr->func_arg_size >= 1);
         assert(curr->func_arg[0] != NULL);
         float percent = atof(curr->func_arg[0]);
         if (percent > 0.0f && percent < 1.0f)
           param->ratio = percent;
         param->strategy = atoi(curr->func_arg[1]);
+        if (curr->func_arg_size > 2)
+          param->seed = strtoull(curr->func_arg[2], NULL, 10);
         pcp_process_legs_append(pcp_sample_p, param);
         break;
       }
       case PCP_PROC_VOXEL:
       {
-        float *param = (float *)malloc(sizeof(float));
-        *param       = atof(curr->func_arg[0]);
+        pcp_voxel_p_arg_t *param =
+            (pcp_voxel_p_arg_t *)malloc(sizeof(pcp_voxel_p_arg_t));
+        *param = (pcp_voxel_p_arg_t){1.0f, PCP_VOXEL_AVERAGE};
+        assert(curr->func_arg_size >= 1);
+        assert(curr->func_arg[0] != NULL);
+        param->step_size = atof(curr->func_arg[0]);
+        if (curr->func_arg_size > 1)
+          param->policy = atoi(curr->func_arg[1]);
         pcp_process_legs_append(pcp_voxel_p, param);
         break;
       }
       case PCP_PROC_REMOVE_DUPLICATES:
       {
-        pcp_process_legs_append(pcp_remove_dupplicates_p, NULL);
+        unsigned char *param =
+            (unsigned char *)malloc(sizeof(unsigned char));
+        *param = PCP_DEDUP_KEEP_FIRST;
+        if (curr->func_arg_size > 0)
+          *param = atoi(curr->func_arg[0]);
+        pcp_process_legs_append(pcp_remove_dupplicates_p, param);
         break;
       }
       default:
@@ -224,63 +485,95 @@ int pcp_prepare(struct arguments *arg)
       }
     }
   }
-  curr_time = get_current_time_ms();
-  /******************************************/
+}
+
+void pcp_legs_run(pointcloud_t *pcs, int count)
+{
   // Run processes
-  for (int t = 0; t < proc_count; t++)
-    pcp_process_legs_run(&proc_pcs[t], t);
+  for (int t = 0; t < count; t++)
+    pcp_process_legs_run(&pcs[t], t);
   // Run statuses
-  for (int t = 0; t < proc_count; t++)
-    pcp_status_legs_run(&proc_pcs[t], t);
-  /******************************************/
-  proc_time = get_current_time_ms() - curr_time;
-
-  pcp_free_param();
-
-  curr_time = get_current_time_ms();
+  for (int t = 0; t < count; t++)
+    pcp_status_legs_run(&pcs[t], t);
+}
 
+int pcp_post_process(struct arguments   *arg,
+                     pointcloud_t      **pcs,
+                     int                 count,
+                     pointcloud_arena_t *arena)
+{
+  pointcloud_t *proc_pcs  = *pcs;
+  pointcloud_t *out_pcs   = NULL;
+  int           out_count = 0;
   if (arg->plan & PCP_PLAN_NONE_MERGE)
   {
     out_pcs   = (pointcloud_t *)malloc(sizeof(pointcloud_t));
-    out_count = pointcloud_merge(proc_pcs, proc_count, &out_pcs[0]);
-    for (int i = 0; i < proc_count; i++)
+    out_count = pointcloud_merge(proc_pcs, count, &out_pcs[0]);
+    for (int i = 0; i < count; i++)
       pointcloud_free(&proc_pcs[i]);
     free(proc_pcs);
   }
   else if (arg->plan & PCP_PLAN_NONE_TILE)
   {
-    int nx    = 0;
-    int ny    = 0;
-    int nz    = 0;
-    nx        = arg->tile.nx;
-    ny        = arg->tile.ny;
-    nz        = arg->tile.nz;
-    out_count = pointcloud_tile(proc_pcs[0], nx, ny, nz, &out_pcs);
-    for (int i = 0; i < proc_count; i++)
+    out_count = pcp_tile(arg, &proc_pcs[0], arena, &out_pcs);
+    for (int i = 1; i < count; i++)
       pointcloud_free(&proc_pcs[i]);
     free(proc_pcs);
   }
   else
   {
     out_pcs   = proc_pcs;
-    out_count = proc_count;
+    out_count = count;
   }
+  *pcs = out_pcs;
+  return out_count;
+}
+
+int pcp_prepare(struct arguments *arg)
+{
+  pointcloud_arena_t arena;
+
+  pointcloud_t *pcs            = NULL;
+  int           proc_count     = 0;
+  int           in_count       = 0;
+  int           out_count      = 0;
+  long long     read_time      = 0;
+  long long     pre_proc_time  = 0;
+  long long     proc_time      = 0;
+  long long     post_proc_time = 0;
+  long long     write_time     = 0;
+  long long     curr_time      = 0;
+
+  curr_time                    = get_current_time_ms();
+  in_count                     = pcp_load(arg, 0, &pcs);
+  read_time  = get_current_time_ms() - curr_time;
+
+  curr_time  = get_current_time_ms();
+  pointcloud_arena_init(&arena, 0);
+  proc_count = pcp_pre_process(arg, &pcs, in_count, &arena);
+  pre_proc_time = get_current_time_ms() - curr_time;
 
+  pcp_legs_setup(arg);
+  curr_time = get_current_time_ms();
+  /******************************************/
+  pcp_legs_run(pcs, proc_count);
+  /******************************************/
+  proc_time = get_current_time_ms() - curr_time;
+
+  pcp_free_param();
+
+  curr_time      = get_current_time_ms();
+  out_count      = pcp_post_process(arg, &pcs, proc_count, &arena);
   post_proc_time = get_current_time_ms() - curr_time;
 
   curr_time      = get_current_time_ms();
 
   if (proc_count == 0)
-    return 0;
-  for (int t = 0; t < out_count; t++)
   {
-    if (out_pcs[t].size == 0)
-    {
-      printf("Tile %d have no points, skip writing...\n", t);
-    }
-    snprintf(output_tile_path, max_path_size, output_path, t);
-    pointcloud_write(out_pcs[t], output_tile_path, binary);
+    pointcloud_arena_free(&arena);
+    return 0;
   }
+  pcp_write_tiles(arg, pcs, out_count, 0);
 
   write_time = get_current_time_ms() - curr_time;
 
@@ -294,15 +587,245 @@ int pcp_prepare(struct arguments *arg)
          write_time);
 
   for (int i = 0; i < out_count; i++)
-    pointcloud_free(&out_pcs[i]);
-  free(out_pcs);
-
-  free(input_tile_path);
-  free(output_tile_path);
+    pointcloud_free(&pcs[i]);
+  free(pcs);
+  pointcloud_arena_free(&arena);
 
   return proc_count;
 }
 
+typedef struct pcp_frame_t
+{
+  int                 frame;
+  pointcloud_t       *pcs;
+  int                 count;
+  pointcloud_arena_t *arena;
+  long long           read_time;
+  long long           proc_time;
+} pcp_frame_t;
+
+// The arenas of the frames in flight: one being processed, those
+// queued for writing and the one being written. Arenas are reused
+// across frames so tiling stops allocating once they have grown.
+typedef struct pcp_arena_pool_t
+{
+  pointcloud_arena_t  arenas[PCP_FRAME_QUEUE_SIZE + 2];
+  pointcloud_arena_t *free[PCP_FRAME_QUEUE_SIZE + 2];
+  int                 count;
+  pthread_mutex_t     lock;
+  pthread_cond_t      released;
+} pcp_arena_pool_t;
+
+void pcp_arena_pool_init(pcp_arena_pool_t *p)
+{
+  p->count = PCP_FRAME_QUEUE_SIZE + 2;
+  for (int i = 0; i < p->count; i++)
+  {
+    pointcloud_arena_init(&p->arenas[i], 0);
+    p->free[i] = &p->arenas[i];
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->released, NULL);
+}
+void pcp_arena_pool_destroy(pcp_arena_pool_t *p)
+{
+  for (int i = 0; i < PCP_FRAME_QUEUE_SIZE + 2; i++)
+    pointcloud_arena_free(&p->arenas[i]);
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->released);
+}
+pointcloud_arena_t *pcp_arena_acquire(pcp_arena_pool_t *p)
+{
+  pointcloud_arena_t *arena = NULL;
+  pthread_mutex_lock(&p->lock);
+  while (p->count == 0)
+    pthread_cond_wait(&p->released, &p->lock);
+  arena = p->free[--p->count];
+  pthread_mutex_unlock(&p->lock);
+  return arena;
+}
+void pcp_arena_release(pcp_arena_pool_t *p, pointcloud_arena_t *arena)
+{
+  pthread_mutex_lock(&p->lock);
+  p->free[p->count++] = arena;
+  pthread_cond_signal(&p->released);
+  pthread_mutex_unlock(&p->lock);
+}
+
+// A bounded FIFO of frames between two pipeline stages.
+typedef struct pcp_queue_t
+{
+  pcp_frame_t     items[PCP_FRAME_QUEUE_SIZE];
+  int             head;
+  int             size;
+  int             closed;
+  pthread_mutex_t lock;
+  pthread_cond_t  not_empty;
+  pthread_cond_t  not_full;
+} pcp_queue_t;
+
+void pcp_queue_init(pcp_queue_t *q)
+{
+  q->head   = 0;
+  q->size   = 0;
+  q->closed = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+}
+void pcp_queue_destroy(pcp_queue_t *q)
+{
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->not_empty);
+  pthread_cond_destroy(&q->not_full);
+}
+void pcp_queue_push(pcp_queue_t *q, pcp_frame_t item)
+{
+  pthread_mutex_lock(&q->lock);
+  while (q->size == PCP_FRAME_QUEUE_SIZE)
+    pthread_cond_wait(&q->not_full, &q->lock);
+  q->items[(q->head + q->size) % PCP_FRAME_QUEUE_SIZE] = item;
+  q->size++;
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+// No more frames will be pushed.
+void pcp_queue_close(pcp_queue_t *q)
+{
+  pthread_mutex_lock(&q->lock);
+  q->closed = 1;
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+// returns 0 once the queue is closed and drained
+int pcp_queue_pop(pcp_queue_t *q, pcp_frame_t *item)
+{
+  pthread_mutex_lock(&q->lock);
+  while (q->size == 0 && !q->closed)
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  if (q->size == 0)
+  {
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+  }
+  *item   = q->items[q->head];
+  q->head = (q->head + 1) % PCP_FRAME_QUEUE_SIZE;
+  q->size--;
+  pthread_cond_signal(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+  return 1;
+}
+
+typedef struct pcp_pipeline_t
+{
+  struct arguments *arg;
+  pcp_queue_t       loaded;
+  pcp_queue_t       processed;
+  pcp_arena_pool_t  arenas;
+} pcp_pipeline_t;
+
+static void *pcp_load_stage(void *ctx)
+{
+  pcp_pipeline_t   *pl  = (pcp_pipeline_t *)ctx;
+  struct arguments *arg = pl->arg;
+  for (int f = 0; f < arg->frames_count; f++)
+  {
+    pcp_frame_t item      = {.frame = arg->frames_start + f};
+    long long   curr_time = get_current_time_ms();
+    item.count     = pcp_load(arg, item.frame, &item.pcs);
+    item.read_time = get_current_time_ms() - curr_time;
+    pcp_queue_push(&pl->loaded, item);
+  }
+  pcp_queue_close(&pl->loaded);
+  return NULL;
+}
+
+static void pcp_write_frame(pcp_pipeline_t *pl, pcp_frame_t item)
+{
+  struct arguments *arg = pl->arg;
+  long long curr_time = get_current_time_ms();
+  pcp_write_tiles(arg, item.pcs, item.count, item.frame);
+  printf("frame %d read time:\t%lld ms\n"
+         "frame %d process time:\t%lld ms\n"
+         "frame %d write time:\t%lld ms\n",
+         item.frame,
+         item.read_time,
+         item.frame,
+         item.proc_time,
+         item.frame,
+         get_current_time_ms() - curr_time);
+  for (int i = 0; i < item.count; i++)
+    pointcloud_free(&item.pcs[i]);
+  free(item.pcs);
+  pcp_arena_release(&pl->arenas, item.arena);
+}
+
+static void *pcp_write_stage(void *ctx)
+{
+  pcp_pipeline_t *pl = (pcp_pipeline_t *)ctx;
+  pcp_frame_t     item;
+  while (pcp_queue_pop(&pl->processed, &item))
+    pcp_write_frame(pl, item);
+  return NULL;
+}
+
+// Runs `arg->frames_count` frames as a three-stage pipeline: a thread
+// loads frame N + 1 while this one processes frame N and another one
+// writes frame N - 1. The bounded queues between the stages cap the
+// number of frames held in memory.
+int pcp_prepare_frames(struct arguments *arg)
+{
+  pcp_pipeline_t pl        = {.arg = arg};
+  pthread_t      loader;
+  pthread_t      writer;
+  pcp_frame_t    item;
+  int            writing   = 0;
+  long long      curr_time = get_current_time_ms();
+
+  pcp_queue_init(&pl.loaded);
+  pcp_queue_init(&pl.processed);
+  pcp_arena_pool_init(&pl.arenas);
+  if (pthread_create(&loader, NULL, pcp_load_stage, &pl) != 0)
+  {
+    pcp_queue_destroy(&pl.loaded);
+    pcp_queue_destroy(&pl.processed);
+    pcp_arena_pool_destroy(&pl.arenas);
+    return 0;
+  }
+  // without a writer thread, frames are written after processing
+  writing = pthread_create(&writer, NULL, pcp_write_stage, &pl) == 0;
+  pcp_legs_setup(arg);
+
+  while (pcp_queue_pop(&pl.loaded, &item))
+  {
+    long long start = get_current_time_ms();
+    item.arena      = pcp_arena_acquire(&pl.arenas);
+    item.count =
+        pcp_pre_process(arg, &item.pcs, item.count, item.arena);
+    pcp_frame_g = item.frame;
+    pcp_legs_run(item.pcs, item.count);
+    item.count =
+        pcp_post_process(arg, &item.pcs, item.count, item.arena);
+    item.proc_time = get_current_time_ms() - start;
+    if (writing)
+      pcp_queue_push(&pl.processed, item);
+    else
+      pcp_write_frame(&pl, item);
+  }
+  pcp_queue_close(&pl.processed);
+
+  pthread_join(loader, NULL);
+  if (writing)
+    pthread_join(writer, NULL);
+  pcp_free_param();
+  pcp_frame_g = -1;
+  pcp_queue_destroy(&pl.loaded);
+  pcp_queue_destroy(&pl.processed);
+  pcp_arena_pool_destroy(&pl.arenas);
+  printf("total time:\t%lld ms\n", get_current_time_ms() - curr_time);
+  return arg->frames_count;
+}
+
 const char *argp_program_version     = "pcp 1.0";
 const char *argp_program_bug_address = "quang.nglong@gmail.com";
 
@@ -319,6 +842,12 @@ static struct argp_option options[] = {
     {"binary",
      'b', "0|1",
      0, "Output binary or not (0 for not, default is 1)."},
+    {"format",
+     'f', "PLY|PCB|PCT",
+     0, "Output file format (default is PLY). PCB is the native "
+     "format of the library, which loads in constant time. PCT "
+     "stores all the tiles in one file. Inputs can be in any of "
+     "these formats."},
     {"pre-process",
      0x80, "ACTION",
      0, "Set the pre-process action of the program (ACTION can be "
@@ -335,6 +864,34 @@ static struct argp_option options[] = {
      0x82, "NUM",
      0, "Input NUM point cloud tiles (1 for normal input, default is "
      "1)."},
+    {"threads",
+     0x83, "NUM",
+     0, "Number of threads used by the parallel routines of the "
+     "library (default is the number of online processors)."},
+    {"quantize",
+     0x88, "BITS",
+     0, "Store the positions of each PLY output as BITS-bit integers "
+     "(1 to 24) relative to its bounding box (default is 0, float "
+     "positions)."},
+    {"io-threads",
+     0x86, "NUM",
+     0, "Number of output files written concurrently (default is "
+     "1)."},
+    {"frames",
+     0x87, "START:COUNT",
+     0, "Prepare COUNT frames starting at START, loading, processing "
+     "and writing consecutive frames concurrently. The frame number "
+     "is the first argument of the input, output and status output "
+     "patterns, before the tile index."},
+    {"stream",
+     0x84, "NUM",
+     0, "Tile the input NUM points at a time, writing tiles while "
+     "reading so that memory use doesn't depend on the cloud size "
+     "(requires --pre-process=TILE, default is 0 for off)."},
+    {"aabb",
+     0x85, "minx,miny,minz,maxx,maxy,maxz",
+     0, "Bounding box of the tile grid for --stream (default is the "
+     "bounds of the input, found in a first pass)."},
     {"tile",
      't', "nx,ny,nz",
      0, "Set the number of division per axis for tiling (default is "
@@ -354,9 +911,9 @@ static char process_doc[] =
     "Defines a specific process to be applied to the point cloud.";
 static struct argp_option process_options[] = {
     {"help", 0, NULL, OPTION_DOC, "Give this help list"},
-    {"sample", 0, NULL, OPTION_DOC, "<ratio=FLOAT> <binary=0|1>"},
-    {"voxel", 0, NULL, OPTION_DOC, "<voxel-size=FLOAT>"},
-    {"remove-duplicates", 0, NULL, OPTION_DOC, "No arguments"},
+    {"sample", 0, NULL, OPTION_DOC, "<ratio=FLOAT> <strategy=0|1|2> [<seed=INT>]"},
+    {"voxel", 0, NULL, OPTION_DOC, "<voxel-size=FLOAT> [<color=0|1>]"},
+    {"remove-duplicates", 0, NULL, OPTION_DOC, "[<color=0|1>]"},
     {0}
 };
 
@@ -446,6 +1003,16 @@ static int parse_func_opt(char              *arg,
     curr->func_arg[i] = safe_dup(arg);
     curr->func_arg_size++;
   }
+  // then the optional ones, up to the next option
+  for (int i = info->min_args; i < info->max_args; i++)
+  {
+    arg = state->argv[state->next];
+    if (!arg || arg[0] == '-')
+      break;
+    state->next++;
+    curr->func_arg[i] = safe_dup(arg);
+    curr->func_arg_size++;
+  }
   return 1;
 }
 
@@ -469,6 +1036,27 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     // add safe input
     args->binary = atoi(arg);
     break;
+  case 'f':
+  {
+    if (strcmp(arg, "PLY") == 0)
+    {
+      args->format = PCP_FORMAT_PLY;
+    }
+    else if (strcmp(arg, "PCB") == 0)
+    {
+      args->format = PCP_FORMAT_PCB;
+    }
+    else if (strcmp(arg, "PCT") == 0)
+    {
+      args->format = PCP_FORMAT_PCT;
+    }
+    else
+    {
+      argp_error(state, "Invalid format. Use: PLY, PCB or PCT");
+      return ARGP_ERR_UNKNOWN;
+    }
+    break;
+  }
   case 0x80:
   {
     if (strcmp(arg, "TILE") == 0)
@@ -517,6 +1105,56 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     // add safe input
     args->tiled_input = atoi(arg);
     break;
+  case 0x83:
+    set_thread_count(atoi(arg));
+    break;
+  case 0x84:
+    args->stream = strtoull(arg, NULL, 10);
+    break;
+  case 0x86:
+    args->io_threads = atoi(arg);
+    break;
+  case 0x88:
+    args->quantize = atoi(arg);
+    if (args->quantize < 0 || args->quantize > 24)
+    {
+      argp_error(state, "Invalid quantization, BITS is 1 to 24");
+      return ARGP_ERR_UNKNOWN;
+    }
+    break;
+  case 0x87:
+  {
+    if (sscanf(arg,
+               "%d:%d",
+               &args->frames_start,
+               &args->frames_count) != 2 ||
+        args->frames_count <= 0)
+    {
+      argp_error(state, "Invalid frames format. Use: START:COUNT");
+      return ARGP_ERR_UNKNOWN;
+    }
+    break;
+  }
+  case 0x85:
+  {
+    aabb_t *aabb = &args->aabb_value;
+    if (sscanf(arg,
+               "%f,%f,%f,%f,%f,%f",
+               &aabb->min.x,
+               &aabb->min.y,
+               &aabb->min.z,
+               &aabb->max.x,
+               &aabb->max.y,
+               &aabb->max.z) != 6)
+    {
+      argp_error(state,
+                 "Invalid aabb format. Use: "
+                 "minx,miny,minz,maxx,maxy,maxz");
+      return ARGP_ERR_UNKNOWN;
+    }
+    args->aabb = aabb;
+    break;
+  }
   case 't':
   {
     if (sscanf(arg,
@@ -559,6 +1197,20 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     args->stats_size++;
     break;
   }
+  case ARGP_KEY_END:
+  {
+    if ((args->plan & PCP_PLAN_TILE_NONE &&
+         args->plan & PCP_PLAN_NONE_TILE) ||
+        (args->plan & PCP_PLAN_MERGE_NONE &&
+         args->plan & PCP_PLAN_NONE_MERGE))
+    {
+      argp_error(state,
+                 "Post-process ACTION must be different from "
+                 "pre-process ACTION, except for action NONE");
+      return ARGP_ERR_UNKNOWN;
+    }
+    break;
+  }
   default:
     return ARGP_ERR_UNKNOWN;
   }
@@ -571,15 +1223,22 @@ int                main(int argc, char *argv[])
 {
   // default param for args
   struct arguments args = (struct arguments){
-      .flags       = 0,
-      .input       = NULL,
-      .output      = NULL,
-      .binary      = 1,
-      .tiled_input = 1,
-      .plan        = PCP_PLAN_NONE_NONE,
-      .procs_size  = 0,
-      .stats_size  = 0,
-      .tile        = {1, 1, 1}
+      .flags        = 0,
+      .input        = NULL,
+      .output       = NULL,
+      .binary       = 1,
+      .format       = PCP_FORMAT_PLY,
+      .quantize     = 0,
+      .tiled_input  = 1,
+      .io_threads   = 1,
+      .frames_start = 0,
+      .frames_count = 0,
+      .stream       = 0,
+      .aabb         = NULL,
+      .plan         = PCP_PLAN_NONE_NONE,
+      .procs_size   = 0,
+      .stats_size   = 0,
+      .tile         = {1, 1, 1}
   };
 
   argp_parse(&argp, argc, argv, 0, 0, &args);
@@ -588,7 +1247,12 @@ int                main(int argc, char *argv[])
   printf("output:\t%s\n", args.output);
   printf("binary:\t%d\n", args.binary);
 
-  pcp_prepare(&args);
+  if (args.stream > 0)
+    pcp_prepare_stream(&args);
+  else if (args.frames_count > 0)
+    pcp_prepare_frames(&args);
+  else
+    pcp_prepare(&args);
 
   arguments_free(&args);
   return 0;
@@ -22,6 +22,10 @@
 #endif
 #define PCP_STAT_SCREEN_AREA_ESTIMATION 0x03
 
+#define PCP_FORMAT_PLY                  0x00
+#define PCP_FORMAT_PCB                  0x01
+#define PCP_FORMAT_PCT                  0x02
+
 #define PCP_PLAN_NONE_NONE              0x00
 #define PCP_PLAN_NONE_TILE              0x01
 #define PCP_PLAN_NONE_MERGE             0x02
@@ -31,6 +35,8 @@
 #define PCP_PLAN_MERGE_TILE             0x21
 
 #define SIZE_PATH                       0xffff
+// frames waiting between two stages of the --frames pipeline
+#define PCP_FRAME_QUEUE_SIZE            2
 #define SET_OPT_PROCESS                 0x0001
 #define SET_OPT_STATUS                  0x0002
 
@@ -50,9 +56,9 @@ typedef struct func_info
 } func_info_t;
 
 const func_info_t processes_g[] = {
-    {           "sample",            PCP_PROC_SAMPLE, 2, 2},
-    {            "voxel",             PCP_PROC_VOXEL, 1, 1},
-    {"remove-duplicates", PCP_PROC_REMOVE_DUPLICATES, 0, 0},
+    {           "sample",            PCP_PROC_SAMPLE, 2, 3},
+    {            "voxel",             PCP_PROC_VOXEL, 1, 2},
+    {"remove-duplicates", PCP_PROC_REMOVE_DUPLICATES, 0, 1},
     {               NULL,                          0, 0, 0}
 };
 
@@ -72,7 +78,15 @@ struct arguments
   char         *input;
   char         *output;
   int           binary;
+  unsigned char format;
+  int           quantize;
   int           tiled_input;
+  int           io_threads;
+  int           frames_start;
+  int           frames_count;
+  size_t        stream;
+  aabb_t       *aabb;
+  aabb_t        aabb_value;
   unsigned char plan;
   size_t        procs_size;
   size_t        stats_size;
@@ -123,6 +137,8 @@ unsigned int pcp_process_legs_count_g          = 0;
 func_f       pcp_status_legs_g[MAX_STATUS]     = {NULL};
 void        *pcp_status_params_g[MAX_STATUS]   = {NULL};
 unsigned int pcp_status_legs_count_g           = 0;
+// the frame the legs run on with --frames, or -1
+int          pcp_frame_g                       = -1;
 
 unsigned int pcp_process_legs_append(func_f func, void *param)
 {
@@ -143,9 +159,14 @@ unsigned int pcp_process_legs_run(pointcloud_t *pc, int pc_id)
 {
   for (int i = 0; i < pcp_process_legs_count_g; i++)
   {
-    if (pcp_process_legs_g[i] != NULL)
+    // a failed process leaves the cloud as it was
+    if (pcp_process_legs_g[i] != NULL &&
+        !pcp_process_legs_g[i](pc, pcp_process_params_g[i], pc_id))
     {
-      pcp_process_legs_g[i](pc, pcp_process_params_g[i], pc_id);
+      fprintf(stderr,
+              "Process %d failed on point cloud %d\n",
+              i,
+              pc_id);
     }
   }
 }
@@ -160,6 +181,17 @@ unsigned int pcp_status_legs_run(pointcloud_t *pc, int pc_id)
   }
 }
 
+// Formats the path of a status output: with --frames, the pattern
+// gets the frame number before `a` and `b`, as the input and output
+// patterns do.
+void pcp_status_path(char *path, const char *pattern, int a, int b)
+{
+  if (pcp_frame_g >= 0)
+    snprintf(path, SIZE_PATH, pattern, pcp_frame_g, a, b);
+  else
+    snprintf(path, SIZE_PATH, pattern, a, b);
+}
+
 unsigned int pcp_free_param(void)
 {
   for (int i = 0; i < pcp_process_legs_count_g; i++)
@@ -172,6 +204,7 @@ typedef struct pcp_sample_p_arg_t
 {
   float         ratio;
   unsigned char strategy;
+  uint64_t      seed;
 } pcp_sample_p_arg_t;
 
 unsigned int pcp_sample_p(pointcloud_t *pc, void *arg, int pc_id)
@@ -179,18 +212,28 @@ unsigned int pcp_sample_p(pointcloud_t *pc, void *arg, int pc_id)
   pcp_sample_p_arg_t *param = (pcp_sample_p_arg_t *)arg;
 
   pointcloud_t        out   = {NULL, NULL, 0};
-  pointcloud_sample(*pc, param->ratio, param->strategy, &out);
+  if (pointcloud_sample(
+          *pc, param->ratio, param->strategy, param->seed, &out) < 0)
+    return 0;
   pointcloud_free(pc);
   *pc = out;
   return 1;
 }
 
+typedef struct pcp_voxel_p_arg_t
+{
+  float         step_size;
+  unsigned char policy;
+} pcp_voxel_p_arg_t;
+
 unsigned int pcp_voxel_p(pointcloud_t *pc, void *arg, int pc_id)
 {
-  float        step_size = *(float *)arg;
+  pcp_voxel_p_arg_t *param = (pcp_voxel_p_arg_t *)arg;
 
-  pointcloud_t out       = {NULL, NULL, 0};
-  pointcloud_voxel(*pc, step_size, &out);
+  pointcloud_t       out   = {NULL, NULL, 0};
+  if (pointcloud_voxel(
+          *pc, param->step_size, param->policy, &out) < 0)
+    return 0;
   pointcloud_free(pc);
   *pc = out;
   return 1;
@@ -199,8 +242,11 @@ unsigned int pcp_voxel_p(pointcloud_t *pc, void *arg, int pc_id)
 unsigned int
 pcp_remove_dupplicates_p(pointcloud_t *pc, void *arg, int pc_id)
 {
-  pointcloud_t out = {NULL, NULL, 0};
-  pointcloud_remove_dupplicates(*pc, &out);
+  unsigned char policy = *(unsigned char *)arg;
+
+  pointcloud_t  out    = {NULL, NULL, 0};
+  if (pointcloud_remove_dupplicates(*pc, policy, &out) < 0)
+    return 0;
   pointcloud_free(pc);
   *pc = out;
   return 1;
@@ -217,24 +263,22 @@ unsigned int pcp_aabb_s(pointcloud_t *pc, void *arg, int pc_id)
 {
   pcp_aabb_s_arg_t *param = (pcp_aabb_s_arg_t *)arg;
 
-  vec3f_t           min, max;
-  pointcloud_min(*pc, &min);
-  pointcloud_max(*pc, &max);
+  aabb_t            aabb  = {{0, 0, 0}, {0, 0, 0}};
+  pointcloud_bounds(pc, &aabb);
   if (param->output == 0 || param->output == 2)
   {
-    printf("Min: %f %f %f\n", min.x, min.y, min.z);
-    printf("Max: %f %f %f\n", max.x, max.y, max.z);
+    printf("Min: %f %f %f\n", aabb.min.x, aabb.min.y, aabb.min.z);
+    printf("Max: %f %f %f\n", aabb.max.x, aabb.max.y, aabb.max.z);
     if (param->output == 0)
     {
       return 1;
     }
   }
-  aabb_t aabb = {min, max};
   mesh_t mesh = {0};
   aabb_to_mesh(aabb, &mesh);
 
   char tile_path[SIZE_PATH];
-  snprintf(tile_path, SIZE_PATH, param->output_path, pc_id);
+  pcp_status_path(tile_path, param->output_path, pc_id, 0);
   mesh_write(mesh, tile_path, param->binary);
   mesh_free(&mesh);
   return 1;
@@ -281,7 +325,7 @@ pcp_save_viewport_s(pointcloud_t *pc, void *arg, int pc_id)
     flip_image(row_pointers, cv.pixels, param->width, param->height);
 
     char tile_path[SIZE_PATH];
-    snprintf(tile_path, SIZE_PATH, param->outpath, v, pc_id);
+    pcp_status_path(tile_path, param->outpath, v, pc_id);
     save_viewport(
         row_pointers, param->width, param->height, tile_path);
     for (int i = 0; i < param->height; i++)
@@ -327,7 +371,11 @@ pcp_pixel_per_tile_s(pointcloud_t *pc, void *arg, int pc_id)
                                     &param->mvps[v][0][0],
                                     &pixel_count[v][0]);
   }
-  json_write_tiles_pixel(param->outpath,
+  char path[SIZE_PATH];
+  strcpy(path, param->outpath);
+  if (pcp_frame_g >= 0)
+    pcp_status_path(path, param->outpath, 0, 0);
+  json_write_tiles_pixel(path,
                          num_tile,
                          param->mvp_count,
                          pixel_count,
@@ -354,14 +402,11 @@ pcp_screen_area_estimation_s(pointcloud_t *pc, void *arg, int pc_id)
   pcp_screen_area_estimation_s_arg_t *param =
       (pcp_screen_area_estimation_s_arg_t *)arg;
 
-  vec3f_t min, max;
-  pointcloud_min(*pc, &min);
-  pointcloud_max(*pc, &max);
-
-  aabb_t aabb   = {.min = min, .max = max};
+  aabb_t aabb   = {{0, 0, 0}, {0, 0, 0}};
   mesh_t aabb_m = {
       .indices = NULL, .num_indices = 0, .num_verts = 0, .pos = NULL};
 
+  pointcloud_bounds(pc, &aabb);
   aabb_to_mesh(aabb, &aabb_m);
 
   screen_ratio = (float *)malloc(sizeof(float) * param->mvp_count);
@@ -371,7 +416,7 @@ pcp_screen_area_estimation_s(pointcloud_t *pc, void *arg, int pc_id)
         aabb_m, &param->mvps[v][0][0], &screen_ratio[v]);
   }
   char pc_path[SIZE_PATH];
-  snprintf(pc_path, SIZE_PATH, param->outpath, pc_id);
+  pcp_status_path(pc_path, param->outpath, pc_id, 0);
   json_write_screen_area_estimation(pc_path,
                                     param->mvp_count,
                                     param->width,
@@ -110,16 +110,13 @@ fi
 
 
 mkdir $TMP_FOLDER
-for i in $(seq $start_in $(($start_in + $num_in - 1))); do
-    file=$(printf "$input" "$i")
-    i_padded=$(printf "%04d" "$i")
-    cmd="${PCP}
-    -i ${file}
-    -o ${TMP_FOLDER}/t%d.f${i_padded}.ply
-    --pre-process=TILE
-    -t ${tiling}"
-    eval $cmd
-done
+cmd="${PCP}
+-i ${input}
+-o ${TMP_FOLDER}/t%d.f%04d.ply
+--pre-process=TILE
+-t ${tiling}
+--frames=${start_in}:${num_in}"
+eval $cmd
 
 mkdir "${output}"
 for ((t=0; t<TILE_COUNT; t++)); do
@@ -6,6 +6,11 @@
 #include <string.h>
 #include <time.h>
 #define MAX_POINTS 10 // Maximum points after clipping
+// samples below 1 / PCP_SAMPLE_FLOYD_RATIO of the indices are drawn
+// with Floyd's algorithm, larger ones by sequential skips
+#define PCP_SAMPLE_FLOYD_RATIO 16
+// free slot of the set of indices drawn by Floyd's algorithm
+#define PCP_SAMPLE_EMPTY       SIZE_MAX
 
 int float_error(float a, float b, float e)
 {
@@ -116,35 +121,140 @@ long long get_current_time_ms(void)
   return (ts.tv_sec * 1000LL) + (ts.tv_nsec / 1000000LL);
 }
 
-int sample_union(int *input,
-                 int  input_size,
-                 int *output,
-                 int  output_size)
+// seeds the stream of draws
+static uint64_t random_mix(uint64_t z)
 {
-  if (output_size > input_size)
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+uint64_t random_u64(uint64_t seed, uint64_t counter)
+{
+  // splitmix64 at state `counter` of a stream keyed by `seed`
+  return random_mix(random_mix(seed) +
+                    (counter + 1) * 0x9e3779b97f4a7c15ull);
+}
+
+uint64_t random_below(uint64_t seed,
+                      uint64_t counter,
+                      uint64_t bound)
+{
+  // the bias of the modulo is below bound / 2^64
+  return random_u64(seed, counter) % bound;
+}
+
+double random_unit(uint64_t seed, uint64_t counter)
+{
+  return (random_u64(seed, counter) >> 11) * 0x1.0p-53;
+}
+
+static int size_compare(const void *a, const void *b)
+{
+  size_t x = *(const size_t *)a;
+  size_t y = *(const size_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Adds `v` to the open addressing set `set` of `cap` slots, a power
+// of two. Returns 0 if it was already there.
+static int sample_set_insert(size_t *set, size_t cap, size_t v)
+{
+  size_t h = (size_t)random_mix(v) & (cap - 1);
+  while (set[h] != PCP_SAMPLE_EMPTY)
   {
-    return -1;
+    if (set[h] == v)
+      return 0;
+    h = (h + 1) & (cap - 1);
   }
-  // Create an array to keep track of selected indices
-  int *selected = calloc(input_size, sizeof(int));
-  if (!selected)
-  {
+  set[h] = v;
+  return 1;
+}
+
+// Floyd's algorithm: draw j + 1 - k times among the first j indices
+// and keep j itself when the draw was already taken.
+static int
+sample_floyd(uint64_t seed, size_t n, size_t k, size_t *out)
+{
+  size_t  cap  = 4;
+  size_t  used = 0;
+  size_t *set  = NULL;
+  while (cap < 2 * k)
+    cap <<= 1;
+  set = (size_t *)malloc(sizeof(size_t) * cap);
+  if (!set)
     return -1;
+  for (size_t i = 0; i < cap; i++)
+    set[i] = PCP_SAMPLE_EMPTY;
+  for (size_t j = n - k; j < n; j++)
+    if (!sample_set_insert(set, cap, random_below(seed, j, j + 1)))
+      sample_set_insert(set, cap, j);
+  for (size_t i = 0; i < cap; i++)
+    if (set[i] != PCP_SAMPLE_EMPTY)
+      out[used++] = set[i];
+  qsort(out, k, sizeof(size_t), size_compare);
+  free(set);
+  return (int)k;
+}
+
+// Vitter's algorithm A: one draw per pick gives how many indices to
+// skip before it, the remaining ones being `left`, `top` of which
+// are not picked.
+static void
+sample_skip(uint64_t seed, size_t n, size_t k, size_t *out)
+{
+  double top  = (double)(n - k);
+  double left = (double)n;
+  size_t next = 0;
+  for (size_t j = 0; j < k; j++)
+  {
+    double v    = random_unit(seed, j);
+    size_t skip = 0;
+    if (j + 1 == k)
+      skip = (size_t)(left * v);
+    else
+      for (double quot = top / left; quot > v; skip++)
+      {
+        top  -= 1.0;
+        left -= 1.0;
+        quot *= top / left;
+      }
+    next   += skip;
+    out[j]  = next++;
+    left   -= 1.0;
   }
-  // Seed the random number generator
-  srand((unsigned int)time(NULL));
-  int selected_count = 0;
-  while (selected_count < output_size)
+}
+
+int sample_indices(uint64_t seed, size_t n, size_t k, size_t *out)
+{
+  if (k > n)
+    return -1;
+  if (k < n / PCP_SAMPLE_FLOYD_RATIO)
+    return sample_floyd(seed, n, k, out);
+  sample_skip(seed, n, k, out);
+  return (int)k;
+}
+
+int sample_union(int     *input,
+                 int      input_size,
+                 int     *output,
+                 int      output_size,
+                 uint64_t seed)
+{
+  size_t *picks = NULL;
+  if (output_size < 0 || output_size > input_size)
+    return -1;
+  picks = (size_t *)malloc(sizeof(size_t) * (output_size + 1));
+  if (!picks ||
+      sample_indices(seed, input_size, output_size, picks) < 0)
   {
-    int index = rand() % input_size;
-    // Ensure no duplicates
-    if (!selected[index])
-    {
-      selected[index]          = 1;
-      output[selected_count++] = input[index];
-    }
+    free(picks);
+    return -1;
   }
-  free(selected);
+  for (int i = 0; i < output_size; i++)
+    output[i] = input[picks[i]];
+  free(picks);
+  return output_size;
 }
 float quantize(float x, float q)
 {
@@ -0,0 +1,382 @@
+// Shortest round-trip float to decimal conversion, after Ulf Adams'
+// Ryu (https://github.com/ulfjack/ryu, Apache-2.0 / Boost-1.0).
+#include <f2s.h>
+#include <stdint.h>
+#include <string.h>
+
+#define F2S_MANTISSA_BITS     23
+#define F2S_EXPONENT_BITS     8
+#define F2S_BIAS              127
+#define F2S_POW5_INV_BITCOUNT 59
+#define F2S_POW5_BITCOUNT     61
+
+// F2S_POW5_INV_SPLIT[q] = floor(2^(pow5bits(q) - 1 + 59) / 5^q) + 1
+// F2S_POW5_SPLIT[i]     = 5^i scaled to 61 significant bits
+static const uint64_t F2S_POW5_INV_SPLIT[31] = {
+    576460752303423489ULL, 461168601842738791ULL,
+    368934881474191033ULL, 295147905179352826ULL,
+    472236648286964522ULL, 377789318629571618ULL,
+    302231454903657294ULL, 483570327845851670ULL,
+    386856262276681336ULL, 309485009821345069ULL,
+    495176015714152110ULL, 396140812571321688ULL,
+    316912650057057351ULL, 507060240091291761ULL,
+    405648192073033409ULL, 324518553658426727ULL,
+    519229685853482763ULL, 415383748682786211ULL,
+    332306998946228969ULL, 531691198313966350ULL,
+    425352958651173080ULL, 340282366920938464ULL,
+    544451787073501542ULL, 435561429658801234ULL,
+    348449143727040987ULL, 557518629963265579ULL,
+    446014903970612463ULL, 356811923176489971ULL,
+    570899077082383953ULL, 456719261665907162ULL,
+    365375409332725730ULL
+};
+
+static const uint64_t F2S_POW5_SPLIT[47] = {
+    1152921504606846976ULL, 1441151880758558720ULL,
+    1801439850948198400ULL, 2251799813685248000ULL,
+    1407374883553280000ULL, 1759218604441600000ULL,
+    2199023255552000000ULL, 1374389534720000000ULL,
+    1717986918400000000ULL, 2147483648000000000ULL,
+    1342177280000000000ULL, 1677721600000000000ULL,
+    2097152000000000000ULL, 1310720000000000000ULL,
+    1638400000000000000ULL, 2048000000000000000ULL,
+    1280000000000000000ULL, 1600000000000000000ULL,
+    2000000000000000000ULL, 1250000000000000000ULL,
+    1562500000000000000ULL, 1953125000000000000ULL,
+    1220703125000000000ULL, 1525878906250000000ULL,
+    1907348632812500000ULL, 1192092895507812500ULL,
+    1490116119384765625ULL, 1862645149230957031ULL,
+    1164153218269348144ULL, 1455191522836685180ULL,
+    1818989403545856475ULL, 2273736754432320594ULL,
+    1421085471520200371ULL, 1776356839400250464ULL,
+    2220446049250313080ULL, 1387778780781445675ULL,
+    1734723475976807094ULL, 2168404344971008868ULL,
+    1355252715606880542ULL, 1694065894508600678ULL,
+    2117582368135750847ULL, 1323488980084844279ULL,
+    1654361225106055349ULL, 2067951531382569187ULL,
+    1292469707114105741ULL, 1615587133892632177ULL,
+    2019483917365790221ULL
+};
+
+// ceil(log2(5^e)) for 0 < e <= 3528, 1 for e == 0
+static inline int32_t pow5bits(int32_t e)
+{
+  return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+// floor(log10(2^e)) for 0 <= e <= 1650
+static inline uint32_t log10_pow2(int32_t e)
+{
+  return ((uint32_t)e * 78913) >> 18;
+}
+// floor(log10(5^e)) for 0 <= e <= 2620
+static inline uint32_t log10_pow5(int32_t e)
+{
+  return ((uint32_t)e * 732923) >> 20;
+}
+
+static inline uint32_t pow5_factor(uint32_t value)
+{
+  uint32_t count = 0;
+  for (;;)
+  {
+    uint32_t q = value / 5;
+    uint32_t r = value - 5 * q;
+    if (r != 0)
+      break;
+    value = q;
+    ++count;
+  }
+  return count;
+}
+static inline int multiple_of_pow5(uint32_t value, uint32_t p)
+{
+  return pow5_factor(value) >= p;
+}
+static inline int multiple_of_pow2(uint32_t value, uint32_t p)
+{
+  return (value & ((1u << p) - 1)) == 0;
+}
+
+static inline uint32_t
+mul_shift(uint32_t m, uint64_t factor, int32_t shift)
+{
+  uint64_t bits0 = (uint64_t)m * (uint32_t)factor;
+  uint64_t bits1 = (uint64_t)m * (uint32_t)(factor >> 32);
+  uint64_t sum   = (bits0 >> 32) + bits1;
+  return (uint32_t)(sum >> (shift - 32));
+}
+
+// Computes the shortest decimal `mantissa * 10^exponent` inside the
+// rounding interval of the float with the given raw fields.
+static void f2d(uint32_t  ieee_mantissa,
+                uint32_t  ieee_exponent,
+                uint32_t *mantissa,
+                int32_t  *exponent)
+{
+  int32_t  e2;
+  uint32_t m2;
+  if (ieee_exponent == 0)
+  {
+    e2 = 1 - F2S_BIAS - F2S_MANTISSA_BITS - 2;
+    m2 = ieee_mantissa;
+  }
+  else
+  {
+    e2 = (int32_t)ieee_exponent - F2S_BIAS - F2S_MANTISSA_BITS - 2;
+    m2 = (1u << F2S_MANTISSA_BITS) | ieee_mantissa;
+  }
+  int      accept_bounds = (m2 & 1) == 0;
+
+  // the interval of valid representations is (mm, mp) around mv
+  uint32_t mv            = 4 * m2;
+  uint32_t mp            = 4 * m2 + 2;
+  uint32_t mm_shift      = ieee_mantissa != 0 || ieee_exponent <= 1;
+  uint32_t mm            = 4 * m2 - 1 - mm_shift;
+
+  uint32_t vr, vp, vm;
+  int32_t  e10;
+  int      vm_trailing_zeros = 0;
+  int      vr_trailing_zeros = 0;
+  uint8_t  last_removed      = 0;
+  if (e2 >= 0)
+  {
+    uint32_t q = log10_pow2(e2);
+    int32_t  k = F2S_POW5_INV_BITCOUNT + pow5bits((int32_t)q) - 1;
+    int32_t  i = -e2 + (int32_t)q + k;
+    e10        = (int32_t)q;
+    vr         = mul_shift(mv, F2S_POW5_INV_SPLIT[q], i);
+    vp         = mul_shift(mp, F2S_POW5_INV_SPLIT[q], i);
+    vm         = mul_shift(mm, F2S_POW5_INV_SPLIT[q], i);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10)
+    {
+      // the last removed digit is needed for correct rounding
+      int32_t l =
+          F2S_POW5_INV_BITCOUNT + pow5bits((int32_t)q - 1) - 1;
+      last_removed = (uint8_t)(mul_shift(mv,
+                                         F2S_POW5_INV_SPLIT[q - 1],
+                                         -e2 + (int32_t)q - 1 + l) %
+                               10);
+    }
+    if (q <= 9)
+    {
+      // only one of mp, mv and mm can be a multiple of 5, if any
+      if (mv % 5 == 0)
+        vr_trailing_zeros = multiple_of_pow5(mv, q);
+      else if (accept_bounds)
+        vm_trailing_zeros = multiple_of_pow5(mm, q);
+      else
+        vp -= (uint32_t)multiple_of_pow5(mp, q);
+    }
+  }
+  else
+  {
+    uint32_t q = log10_pow5(-e2);
+    int32_t  i = -e2 - (int32_t)q;
+    int32_t  k = pow5bits(i) - F2S_POW5_BITCOUNT;
+    int32_t  j = (int32_t)q - k;
+    e10        = (int32_t)q + e2;
+    vr         = mul_shift(mv, F2S_POW5_SPLIT[i], j);
+    vp         = mul_shift(mp, F2S_POW5_SPLIT[i], j);
+    vm         = mul_shift(mm, F2S_POW5_SPLIT[i], j);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10)
+    {
+      j = (int32_t)q - 1 - (pow5bits(i + 1) - F2S_POW5_BITCOUNT);
+      last_removed =
+          (uint8_t)(mul_shift(mv, F2S_POW5_SPLIT[i + 1], j) % 10);
+    }
+    if (q <= 1)
+    {
+      // mv = 4 * m2 always has at least two trailing zero bits
+      vr_trailing_zeros = 1;
+      if (accept_bounds)
+        vm_trailing_zeros = mm_shift == 1;
+      else
+        --vp;
+    }
+    else if (q < 31)
+    {
+      vr_trailing_zeros = multiple_of_pow2(mv, q - 1);
+    }
+  }
+
+  // drop digits while the interval still holds a shorter number
+  int32_t  removed = 0;
+  uint32_t output;
+  if (vm_trailing_zeros || vr_trailing_zeros)
+  {
+    while (vp / 10 > vm / 10)
+    {
+      vm_trailing_zeros &= vm % 10 == 0;
+      vr_trailing_zeros &= last_removed == 0;
+      last_removed = (uint8_t)(vr % 10);
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    if (vm_trailing_zeros)
+    {
+      while (vm % 10 == 0)
+      {
+        vr_trailing_zeros &= last_removed == 0;
+        last_removed = (uint8_t)(vr % 10);
+        vr /= 10;
+        vp /= 10;
+        vm /= 10;
+        ++removed;
+      }
+    }
+    if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+    {
+      // round even when exactly halfway
+      last_removed = 4;
+    }
+    output = vr + (uint32_t)((vr == vm && (!accept_bounds ||
+                                           !vm_trailing_zeros)) ||
+                             last_removed >= 5);
+  }
+  else
+  {
+    while (vp / 10 > vm / 10)
+    {
+      last_removed = (uint8_t)(vr % 10);
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    output = vr + (uint32_t)(vr == vm || last_removed >= 5);
+  }
+  *mantissa = output;
+  *exponent = e10 + removed;
+}
+
+static inline int decimal_length(uint32_t v)
+{
+  int n = 1;
+  while (v >= 10)
+  {
+    v /= 10;
+    n++;
+  }
+  return n;
+}
+
+// writes the lowest `len` digits of `v` ending just before `end` and
+// returns what is left of `v`
+static inline uint32_t write_digits(char *end, uint32_t v, int len)
+{
+  for (int i = 0; i < len; i++)
+  {
+    *--end = (char)('0' + v % 10);
+    v /= 10;
+  }
+  return v;
+}
+
+int f2s_buffered(float f, char *out)
+{
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  int      sign = (int)(bits >> 31);
+  uint32_t ieee_mantissa =
+      bits & ((1u << F2S_MANTISSA_BITS) - 1);
+  uint32_t ieee_exponent = (bits >> F2S_MANTISSA_BITS) &
+                           ((1u << F2S_EXPONENT_BITS) - 1);
+  char    *p             = out;
+
+  if (ieee_exponent == (1u << F2S_EXPONENT_BITS) - 1)
+  {
+    if (ieee_mantissa)
+    {
+      memcpy(out, "nan", 3);
+      return 3;
+    }
+    if (sign)
+      *p++ = '-';
+    memcpy(p, "inf", 3);
+    return (int)(p - out) + 3;
+  }
+  if (sign)
+    *p++ = '-';
+  if (ieee_exponent == 0 && ieee_mantissa == 0)
+  {
+    *p++ = '0';
+    return (int)(p - out);
+  }
+
+  // integers below 2^24 are exact: print them directly
+  int32_t e2 = (int32_t)ieee_exponent - F2S_BIAS;
+  if (e2 >= 0 && e2 <= F2S_MANTISSA_BITS)
+  {
+    uint32_t m2   = (1u << F2S_MANTISSA_BITS) | ieee_mantissa;
+    uint32_t frac = (1u << (F2S_MANTISSA_BITS - e2)) - 1;
+    if ((m2 & frac) == 0)
+    {
+      uint32_t v   = m2 >> (F2S_MANTISSA_BITS - e2);
+      int      len = decimal_length(v);
+      write_digits(p + len, v, len);
+      return (int)(p - out) + len;
+    }
+  }
+
+  uint32_t m;
+  int32_t  e;
+  f2d(ieee_mantissa, ieee_exponent, &m, &e);
+  int len   = decimal_length(m);
+  // value = m * 10^e, so the decimal point sits `point` digits in
+  int point = len + e;
+
+  if (e >= 0 && point <= 9)
+  {
+    // 1234000
+    write_digits(p + len, m, len);
+    p += len;
+    for (int i = 0; i < e; i++)
+      *p++ = '0';
+  }
+  else if (point > 0 && point <= 9)
+  {
+    // 12.34
+    uint32_t hi = write_digits(p + len + 1, m, len - point);
+    write_digits(p + point, hi, point);
+    p[point] = '.';
+    p += len + 1;
+  }
+  else if (point <= 0 && point > -5)
+  {
+    // 0.001234
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = 0; i < -point; i++)
+      *p++ = '0';
+    write_digits(p + len, m, len);
+    p += len;
+  }
+  else
+  {
+    // 1.234e-20
+    int32_t exp10 = point - 1;
+    write_digits(p + 1 + len, m, len);
+    p[0] = p[1];
+    if (len > 1)
+    {
+      p[1] = '.';
+      p += len + 1;
+    }
+    else
+    {
+      p += 1;
+    }
+    *p++ = 'e';
+    if (exp10 < 0)
+    {
+      *p++  = '-';
+      exp10 = -exp10;
+    }
+    int elen = decimal_length((uint32_t)exp10);
+    write_digits(p + elen, (uint32_t)exp10, elen);
+    p += elen;
+  }
+  return (int)(p - out);
+}
@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <gzpipe.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// bytes (de)compressed per round by the background thread
+#define GZPIPE_BLOCK_SIZE 0x40000
+
+struct gzpipe_t
+{
+  FILE           *file;
+  gzFile          gz;
+  int             fd; // the end of the pipe used by the thread
+  char           *buf;
+  int             writing;
+  int             stop;
+  int             failed;
+  pthread_t       thread;
+  pthread_mutex_t lock;
+};
+
+static int gzpipe_stopped(gzpipe_t *p)
+{
+  pthread_mutex_lock(&p->lock);
+  int stop = p->stop;
+  pthread_mutex_unlock(&p->lock);
+  return stop;
+}
+
+static int gzpipe_write_all(int fd, const char *buf, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t n = write(fd, buf, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    buf  += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+// Feeds the inflated file into the pipe until it ends or the reader
+// closes early.
+static void *gzpipe_inflate(void *arg)
+{
+  gzpipe_t *p = (gzpipe_t *)arg;
+  int       n = 0;
+  while (!gzpipe_stopped(p) &&
+         (n = gzread(p->gz, p->buf, GZPIPE_BLOCK_SIZE)) > 0)
+  {
+    if (gzpipe_write_all(p->fd, p->buf, (size_t)n) < 0)
+      break;
+  }
+  close(p->fd);
+  return NULL;
+}
+
+// Deflates what comes out of the pipe until the writer closes it. On
+// failure, the pipe is still drained so the writer never blocks.
+static void *gzpipe_deflate(void *arg)
+{
+  gzpipe_t *p      = (gzpipe_t *)arg;
+  ssize_t   n      = 0;
+  int       failed = 0;
+  while (1)
+  {
+    n = read(p->fd, p->buf, GZPIPE_BLOCK_SIZE);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    if (!failed && gzwrite(p->gz, p->buf, (unsigned)n) != (int)n)
+      failed = 1;
+  }
+  if (gzclose(p->gz) != Z_OK || n < 0)
+    failed = 1;
+  close(p->fd);
+  p->failed = failed;
+  return NULL;
+}
+
+static int gzpipe_has_magic(FILE *file)
+{
+  unsigned char magic[2] = {0, 0};
+  size_t        got      = fread(magic, 1, 2, file);
+  rewind(file);
+  return got == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+static int gzpipe_has_suffix(const char *filename)
+{
+  size_t len = strlen(filename);
+  return len > 3 && strcmp(filename + len - 3, ".gz") == 0;
+}
+
+gzpipe_t *gzpipe_open(const char *filename, const char *mode)
+{
+  int       fds[2];
+  gzpipe_t *p = (gzpipe_t *)calloc(1, sizeof(gzpipe_t));
+  if (!p)
+    return NULL;
+  p->writing = mode[0] == 'w';
+  if (!p->writing || !gzpipe_has_suffix(filename))
+  {
+    p->file = fopen(filename, mode);
+    if (!p->file)
+    {
+      free(p);
+      return NULL;
+    }
+    if (p->writing || !gzpipe_has_magic(p->file))
+      return p;
+    fclose(p->file);
+    p->file = NULL;
+  }
+
+  p->gz  = gzopen(filename, p->writing ? "wb" : "rb");
+  p->buf = (char *)malloc(GZPIPE_BLOCK_SIZE);
+  if (!p->gz || !p->buf || pipe(fds) != 0)
+  {
+    if (p->gz)
+      gzclose(p->gz);
+    free(p->buf);
+    free(p);
+    return NULL;
+  }
+  gzbuffer(p->gz, GZPIPE_BLOCK_SIZE);
+  p->fd   = p->writing ? fds[0] : fds[1];
+  p->file = fdopen(p->writing ? fds[1] : fds[0], mode);
+  pthread_mutex_init(&p->lock, NULL);
+  if (!p->file || pthread_create(&p->thread,
+                                 NULL,
+                                 p->writing ? gzpipe_deflate
+                                            : gzpipe_inflate,
+                                 p) != 0)
+  {
+    if (p->file)
+      fclose(p->file);
+    else
+      close(p->writing ? fds[1] : fds[0]);
+    close(p->fd);
+    gzclose(p->gz);
+    pthread_mutex_destroy(&p->lock);
+    free(p->buf);
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+FILE *gzpipe_file(gzpipe_t *p)
+{
+  return p->file;
+}
+
+int gzpipe_is_compressed(const gzpipe_t *p)
+{
+  return p->gz != NULL;
+}
+
+int gzpipe_close(gzpipe_t *p)
+{
+  int ret = 0;
+  if (!p)
+    return 0;
+  if (!p->gz)
+  {
+    ret = ferror(p->file) | fclose(p->file) ? -1 : 0;
+    free(p);
+    return ret;
+  }
+  if (p->writing)
+  {
+    ret = ferror(p->file) | fclose(p->file) ? -1 : 0;
+    pthread_join(p->thread, NULL);
+    if (p->failed)
+      ret = -1;
+  }
+  else
+  {
+    // Stop the thread, and drain the pipe so it isn't left blocked
+    // on a write.
+    char buf[4096];
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_mutex_unlock(&p->lock);
+    while (fread(buf, 1, sizeof(buf), p->file) > 0)
+      ;
+    fclose(p->file);
+    pthread_join(p->thread, NULL);
+    gzclose(p->gz);
+  }
+  pthread_mutex_destroy(&p->lock);
+  free(p->buf);
+  free(p);
+  return ret;
+}
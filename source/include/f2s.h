@@ -0,0 +1,20 @@
+#ifndef F2S_H
+#define F2S_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// longest output of f2s_buffered, e.g. "-1.17549435e-38"
+#define F2S_MAX_CHARS 16
+
+  // Writes the shortest decimal string that reads back as exactly
+  // `f` (Ryu, Adams 2018) into `out` and returns its length. `out`
+  // must hold F2S_MAX_CHARS bytes; it is not null-terminated.
+  int f2s_buffered(float f, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
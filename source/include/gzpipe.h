@@ -0,0 +1,31 @@
+#ifndef GZPIPE_H
+#define GZPIPE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdio.h>
+
+  // A file whose gzip (de)compression runs on a background thread,
+  // connected to the caller through a pipe.
+  typedef struct gzpipe_t gzpipe_t;
+
+  // Opens `filename` with `mode` "rb" or "wb". Reading inflates the
+  // file if it starts with the gzip magic, writing deflates it if
+  // its name ends in ".gz"; other files are opened as they are.
+  // Returns NULL if the file can't be opened.
+  gzpipe_t *gzpipe_open(const char *filename, const char *mode);
+  // The stream to read or write. It is only seekable when the file
+  // isn't compressed.
+  FILE     *gzpipe_file(gzpipe_t *p);
+  int       gzpipe_is_compressed(const gzpipe_t *p);
+  // Closes the stream and waits for the background thread. Returns
+  // -1 if anything written could not be compressed or stored.
+  int       gzpipe_close(gzpipe_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
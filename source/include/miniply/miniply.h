@@ -32,6 +32,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <string>
 #include <vector>
 
+typedef struct gzpipe_t gzpipe_t;
+
 /// miniply - A simple and fast parser for PLY files
 /// ================================================
 ///
@@ -180,6 +182,15 @@ public:
   bool              load_element();
   void              next_element();
 
+  /// Load the next `maxRows` rows of the current element, or as many
+  /// as are left, in place of the element's full data so that large
+  /// elements can be processed in bounded memory. The `extract_*`
+  /// methods then see only these rows. Returns the number of rows
+  /// loaded, which is 0 once the element is exhausted, if it has
+  /// variable-size rows or if it was already loaded with
+  /// `load_element()`. The two can't be mixed for the same element.
+  uint32_t          load_rows(uint32_t maxRows);
+
   PLYFileType       file_type() const;
   int               version_major() const;
   int               version_minor() const;
@@ -187,6 +198,22 @@ public:
   uint32_t          find_element(const char *name) const;
   PLYElement       *get_element(uint32_t idx);
 
+  /// Byte offset in the file of the current read position. Right
+  /// after the header has been parsed, this is where the data of the
+  /// first element starts.
+  int64_t           file_offset() const;
+
+  /// The underlying file, e.g. for mapping it into memory. It stays
+  /// owned by the reader. For a gzip-compressed file this is the
+  /// read end of a pipe, which can't be mapped or seeked.
+  FILE             *file_handle() const;
+
+  /// Number of `comment` lines in the header.
+  uint32_t          num_comments() const;
+  /// Text of header comment `idx`, without the `comment` keyword, or
+  /// nullptr if `idx` is out of range.
+  const char       *get_comment(uint32_t idx) const;
+
   /// Check whether the current element has the given name.
   bool              element_is(const char *name) const;
 
@@ -303,6 +330,8 @@ private:
   bool parse_property(std::vector<PLYProperty> &properties);
 
   bool load_fixed_size_element(PLYElement &elem);
+  bool load_fixed_size_rows(PLYElement &elem, uint32_t numRows);
+  bool load_ascii_fixed_size_element(PLYElement &elem);
   bool load_variable_size_element(PLYElement &elem);
 
   bool load_ascii_scalar_property(PLYProperty &prop,
@@ -318,6 +347,7 @@ private:
   bool ascii_value(PLYPropertyType propType, uint8_t value[8]);
 
 private:
+  gzpipe_t   *m_pipe          = nullptr;
   FILE       *m_f             = nullptr;
   char       *m_buf           = nullptr;
   const char *m_bufEnd        = nullptr;
@@ -336,9 +366,12 @@ private:
   int m_minorVersion = 0;
   std::vector<PLYElement>
          m_elements; //!< Element descriptors for this file.
+  std::vector<std::string>
+         m_comments; //!< Text of the header comments.
 
-  size_t m_currentElement = 0;
-  bool   m_elementLoaded  = false;
+  size_t   m_currentElement = 0;
+  bool     m_elementLoaded  = false;
+  uint32_t m_rowsLoaded     = 0; //!< Rows read by `load_rows()`.
   std::vector<uint8_t> m_elementData;
 
   char                *m_tmpBuf = nullptr;
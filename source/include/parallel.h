@@ -0,0 +1,33 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+  // Body of a parallel loop: handles items [begin, end) as worker
+  // `tid`, where 0 <= tid < the worker count given to parallel_for.
+  typedef void (*parallel_func_t)(void  *ctx,
+                                  size_t begin,
+                                  size_t end,
+                                  int    tid);
+
+  // Number of workers to use for `n` items so that each worker gets
+  // at least `grain` of them, capped by get_thread_count().
+  int  parallel_workers(size_t n, size_t grain);
+
+  // Runs `func` over [0, n) split into `workers` contiguous ranges,
+  // worker t getting [n * t / workers, n * (t + 1) / workers). The
+  // calling thread runs range 0; returns once every range is done.
+  void parallel_for(size_t          n,
+                    int             workers,
+                    parallel_func_t func,
+                    void           *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
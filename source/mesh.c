@@ -35,9 +35,16 @@ int mesh_free(mesh_t *mesh)
 }
 int mesh_load(mesh_t *mesh, const char *filename)
 {
-  mesh_init(
-      mesh, ply_count_vertex(filename), ply_count_face(filename) * 3);
-  return ply_mesh_loader(filename, mesh->pos, mesh->indices);
+  ply_reader_t *reader = ply_reader_open(filename);
+  if (!reader)
+    return 0;
+  mesh_init(mesh,
+            ply_reader_count_vertex(reader),
+            ply_reader_count_face(reader) * 3);
+  int ret = ply_reader_load_mesh(
+      reader, mesh->pos, (int *)mesh->indices);
+  ply_reader_close(reader);
+  return ret;
 }
 int mesh_write(mesh_t mesh, const char *filename, int binary)
 {
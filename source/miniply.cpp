@@ -24,6 +24,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include "miniply/miniply.h"
+#include "gzpipe.h"
+#include "parallel.h"
 
 #include <cassert>
 #include <cctype>
@@ -54,6 +56,10 @@ const char               *kPLYFaceElement    = "face";
 
 static constexpr uint32_t kPLYReadBufferSize = 128 * 1024;
 static constexpr uint32_t kPLYTempBufferSize = kPLYReadBufferSize;
+// Bytes of an ASCII body parsed per round by the parallel loader.
+static constexpr size_t   kPLYAsciiChunkSize = 32 * 1024 * 1024;
+// Smallest byte range worth handing to a separate thread.
+static constexpr size_t   kPLYAsciiMinPart   = 256 * 1024;
 
 static const char        *kPLYFileTypes[]    = {
     "ascii", "binary_little_endian", "binary_big_endian", nullptr};
@@ -95,6 +101,16 @@ static const PLYTypeAlias kTypeAliases[] = {
 static constexpr double kDoubleDigits[10] = {
     0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0};
 
+// Powers of ten that are exactly representable as doubles.
+static constexpr double kExactPow10[23] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+// Powers of ten that are exact in a float.
+static constexpr float kExactPow10f[11] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+    1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
 static constexpr float kPi = 3.14159265358979323846f;
 
 //
@@ -199,13 +215,12 @@ static inline bool is_safe_buffer_end(char ch)
   return (ch > 0 && ch <= 32) || (ch >= 127);
 }
 
-static int file_open(FILE **f, const char *filename, const char *mode)
+static inline int64_t file_tell(FILE *file)
 {
 #ifdef _WIN32
-  return fopen_s(f, filename, mode);
+  return _ftelli64(file);
 #else
-  *f = fopen(filename, mode);
-  return (*f != nullptr) ? 0 : errno;
+  return ftello(file);
 #endif
 }
 
@@ -220,6 +235,27 @@ static inline int file_seek(FILE *file, int64_t offset, int origin)
 #endif
 }
 
+// Moves `bytes` forward in a stream that can't seek, such as the pipe
+// of a compressed file, by reading past them.
+static bool file_skip(FILE   *file,
+                      int64_t bytes,
+                      char   *scratch,
+                      size_t  scratchSize)
+{
+  while (bytes > 0)
+  {
+    size_t want = bytes < int64_t(scratchSize) ? size_t(bytes)
+                                               : scratchSize;
+    size_t got  = fread(scratch, 1, want, file);
+    if (got == 0)
+    {
+      return false;
+    }
+    bytes -= int64_t(got);
+  }
+  return true;
+}
+
 static bool int_literal(const char *start, char const **end, int *val)
 {
   const char *pos      = start;
@@ -281,6 +317,43 @@ static bool int_literal(const char *start, char const **end, int *val)
   return true;
 }
 
+// Same as int_literal for an unsigned 32-bit value, which can exceed
+// what an int holds.
+static bool
+uint_literal(const char *start, char const **end, uint32_t *val)
+{
+  const char *pos = start;
+  if (*pos == '+')
+  {
+    ++pos;
+  }
+
+  int      numDigits = 0;
+  uint64_t localVal  = 0;
+  while (is_digit(*pos) && localVal <= UINT32_MAX)
+  {
+    localVal = localVal * 10 + static_cast<uint64_t>(*pos - '0');
+    ++numDigits;
+    ++pos;
+  }
+
+  if (numDigits == 0 || localVal > UINT32_MAX || is_letter(*pos) ||
+      *pos == '_')
+  {
+    return false;
+  }
+
+  if (val != nullptr)
+  {
+    *val = static_cast<uint32_t>(localVal);
+  }
+  if (end != nullptr)
+  {
+    *end = pos;
+  }
+  return true;
+}
+
 static bool
 double_literal(const char *start, char const **end, double *val)
 {
@@ -409,6 +482,272 @@ float_literal(const char *start, char const **end, float *val)
   return ok;
 }
 
+// Parses a decimal number with exact rounding. When the digits fit in
+// 53 bits and the decimal exponent is within +-22 the value is the
+// product or quotient of two exact doubles, which needs only one
+// rounding (Clinger's fast path). For floats the same holds within 24
+// bits and +-10, computed in float: going through a double would
+// round twice. Anything else goes to strtod or strtof.
+static bool fast_real_literal(const char  *start,
+                              char const **end,
+                              double      *val,
+                              bool         single)
+{
+  const char *pos = start;
+  if (*pos == '-' || *pos == '+')
+  {
+    ++pos;
+  }
+
+  uint64_t mantissa  = 0;
+  int      numDigits = 0;
+  int      exp10     = 0;
+  bool     hasDigits = false;
+  while (is_digit(*pos))
+  {
+    hasDigits = true;
+    if (numDigits > 0 || *pos != '0')
+    {
+      if (numDigits < 19)
+      {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*pos - '0');
+      }
+      else
+      {
+        exp10++;
+      }
+      numDigits++;
+    }
+    ++pos;
+  }
+  if (*pos == '.')
+  {
+    ++pos;
+    while (is_digit(*pos))
+    {
+      hasDigits = true;
+      if (numDigits > 0 || *pos != '0')
+      {
+        if (numDigits < 19)
+        {
+          mantissa =
+              mantissa * 10 + static_cast<uint64_t>(*pos - '0');
+          exp10--;
+        }
+        numDigits++;
+      }
+      else
+      {
+        exp10--;
+      }
+      ++pos;
+    }
+  }
+  if (!hasDigits)
+  {
+    return false;
+  }
+  if (*pos == 'e' || *pos == 'E')
+  {
+    ++pos;
+    bool negativeExponent = *pos == '-';
+    if (*pos == '-' || *pos == '+')
+    {
+      ++pos;
+    }
+    if (!is_digit(*pos))
+    {
+      return false;
+    }
+    int exponent = 0;
+    while (is_digit(*pos))
+    {
+      if (exponent < 100000)
+      {
+        exponent = exponent * 10 + (*pos - '0');
+      }
+      ++pos;
+    }
+    exp10 += negativeExponent ? -exponent : exponent;
+  }
+  if (*pos == '.' || *pos == '_' || is_alnum(*pos))
+  {
+    return false;
+  }
+
+  double value = 0.0;
+  if (single && numDigits <= 19 && mantissa <= (uint64_t(1) << 24) &&
+      exp10 >= -10 && exp10 <= 10)
+  {
+    float f = static_cast<float>(mantissa);
+    f       = exp10 < 0 ? f / kExactPow10f[-exp10]
+                        : f * kExactPow10f[exp10];
+    value   = static_cast<double>(*start == '-' ? -f : f);
+  }
+  else if (!single && numDigits <= 19 &&
+           mantissa <= (uint64_t(1) << 53) && exp10 >= -22 &&
+           exp10 <= 22)
+  {
+    value = static_cast<double>(mantissa);
+    value = exp10 < 0 ? value / kExactPow10[-exp10]
+                      : value * kExactPow10[exp10];
+    if (*start == '-')
+    {
+      value = -value;
+    }
+  }
+  else if (single)
+  {
+    value = static_cast<double>(std::strtof(start, nullptr));
+  }
+  else
+  {
+    value = std::strtod(start, nullptr);
+  }
+
+  *val = value;
+  *end = pos;
+  return true;
+}
+
+// Parses one ASCII row of a fixed-size element from [pos, lineEnd)
+// into `dst`, laid out like the element's binary rows.
+static bool parse_ascii_row(const char       *pos,
+                            const char       *lineEnd,
+                            const PLYElement &elem,
+                            uint8_t          *dst)
+{
+  for (const PLYProperty &prop : elem.properties)
+  {
+    while (pos < lineEnd && is_whitespace(*pos))
+    {
+      ++pos;
+    }
+    if (pos >= lineEnd)
+    {
+      return false;
+    }
+    uint8_t *out = dst + prop.offset;
+    double   real;
+    int      integer;
+    uint32_t uinteger;
+    switch (prop.type)
+    {
+    case PLYPropertyType::Float:
+    {
+      if (!fast_real_literal(pos, &pos, &real, true))
+      {
+        return false;
+      }
+      float f = static_cast<float>(real);
+      std::memcpy(out, &f, sizeof(f));
+      break;
+    }
+    case PLYPropertyType::Double:
+      if (!fast_real_literal(pos, &pos, &real, false))
+      {
+        return false;
+      }
+      std::memcpy(out, &real, sizeof(real));
+      break;
+    case PLYPropertyType::UInt:
+      if (!uint_literal(pos, &pos, &uinteger))
+      {
+        return false;
+      }
+      std::memcpy(out, &uinteger, sizeof(uinteger));
+      break;
+    default:
+    {
+      if (!int_literal(pos, &pos, &integer))
+      {
+        return false;
+      }
+      uint32_t numBytes = kPLYPropertySize[uint32_t(prop.type)];
+      if (numBytes == 1)
+      {
+        *out = static_cast<uint8_t>(integer);
+      }
+      else if (numBytes == 2)
+      {
+        uint16_t v = static_cast<uint16_t>(integer);
+        std::memcpy(out, &v, sizeof(v));
+      }
+      else
+      {
+        std::memcpy(out, &integer, sizeof(integer));
+      }
+      break;
+    }
+    }
+  }
+  return true;
+}
+
+struct PLYAsciiPart
+{
+  const char *begin;    //!< First byte of this part of the chunk.
+  const char *end;      //!< One past its last newline.
+  uint32_t    firstRow; //!< Row index of the first line.
+  uint32_t    numRows;  //!< Lines to parse; later ones are skipped.
+  bool        ok;
+};
+
+struct PLYAsciiJob
+{
+  const PLYElement *elem;
+  uint8_t          *data;
+  PLYAsciiPart     *parts;
+};
+
+static void count_ascii_lines(void  *ctx,
+                              size_t begin,
+                              size_t end,
+                              int    /*tid*/)
+{
+  PLYAsciiPart *parts = static_cast<PLYAsciiJob *>(ctx)->parts;
+  for (size_t i = begin; i < end; i++)
+  {
+    uint32_t    lines = 0;
+    const char *pos   = parts[i].begin;
+    while ((pos = static_cast<const char *>(std::memchr(
+                pos, '\n', size_t(parts[i].end - pos)))) != nullptr)
+    {
+      ++lines;
+      ++pos;
+    }
+    parts[i].numRows = lines;
+  }
+}
+
+static void parse_ascii_lines(void  *ctx,
+                              size_t begin,
+                              size_t end,
+                              int    /*tid*/)
+{
+  PLYAsciiJob *job = static_cast<PLYAsciiJob *>(ctx);
+  for (size_t i = begin; i < end; i++)
+  {
+    PLYAsciiPart &part = job->parts[i];
+    const char   *line = part.begin;
+    uint8_t      *dst  = job->data + size_t(part.firstRow) *
+                                     job->elem->rowStride;
+    part.ok            = true;
+    for (uint32_t row = 0; row < part.numRows; row++)
+    {
+      const char *lineEnd = static_cast<const char *>(
+          std::memchr(line, '\n', size_t(part.end - line)));
+      if (!parse_ascii_row(line, lineEnd, *job->elem, dst))
+      {
+        part.ok = false;
+        return;
+      }
+      line = lineEnd + 1;
+      dst += job->elem->rowStride;
+    }
+  }
+}
+
 static inline void endian_swap_2(uint8_t *data)
 {
   uint16_t tmp = *reinterpret_cast<uint16_t *>(data);
@@ -732,12 +1071,13 @@ PLYReader::PLYReader(const char *filename)
   m_pos                        = m_bufEnd;
   m_end                        = m_bufEnd;
 
-  if (file_open(&m_f, filename, "rb") != 0)
+  m_pipe = gzpipe_open(filename, "rb");
+  if (m_pipe == nullptr)
   {
-    m_f     = nullptr;
     m_valid = false;
     return;
   }
+  m_f = gzpipe_file(m_pipe);
   m_valid = true;
 
   refill_buffer();
@@ -767,9 +1107,9 @@ PLYReader::PLYReader(const char *filename)
 
 PLYReader::~PLYReader()
 {
-  if (m_f != nullptr)
+  if (m_pipe != nullptr)
   {
-    fclose(m_f);
+    gzpipe_close(m_pipe);
   }
   delete[] m_buf;
   delete[] m_tmpBuf;
@@ -794,6 +1134,10 @@ const PLYElement *PLYReader::element() const
 bool PLYReader::load_element()
 {
   assert(has_element());
+  if (m_rowsLoaded > 0)
+  {
+    return false;
+  }
   if (m_elementLoaded)
   {
     return true;
@@ -804,6 +1148,32 @@ bool PLYReader::load_element()
                         : load_variable_size_element(elem);
 }
 
+uint32_t PLYReader::load_rows(uint32_t maxRows)
+{
+  assert(has_element());
+  PLYElement &elem = m_elements[m_currentElement];
+  if (!elem.fixedSize || (m_elementLoaded && m_rowsLoaded == 0))
+  {
+    return 0;
+  }
+
+  uint32_t numRows = elem.count - m_rowsLoaded;
+  if (numRows > maxRows)
+  {
+    numRows = maxRows;
+  }
+  m_elementData.resize(static_cast<size_t>(numRows) * elem.rowStride);
+  if (numRows == 0 || !load_fixed_size_rows(elem, numRows))
+  {
+    return 0;
+  }
+  m_rowsLoaded += numRows;
+  // Once the last row is in, the read buffer is positioned at the
+  // next element just as after `load_element()`.
+  m_elementLoaded = m_rowsLoaded == elem.count;
+  return numRows;
+}
+
 void PLYReader::next_element()
 {
   if (!has_element())
@@ -814,7 +1184,9 @@ void PLYReader::next_element()
   // If the element was loaded, the read buffer should already be
   // positioned at the start of the next element.
   PLYElement &elem = m_elements[m_currentElement];
+  uint32_t    skip = elem.count - m_rowsLoaded;
   m_currentElement++;
+  m_rowsLoaded = 0;
 
   if (m_elementLoaded)
   {
@@ -845,7 +1217,7 @@ void PLYReader::next_element()
   // is fixed or variable size.
   if (m_fileType == PLYFileType::ASCII)
   {
-    for (uint32_t row = 0; row < elem.count; row++)
+    for (uint32_t row = 0; row < skip; row++)
     {
       next_line();
     }
@@ -853,12 +1225,21 @@ void PLYReader::next_element()
   else if (elem.fixedSize)
   {
     int64_t elementStart = static_cast<int64_t>(m_pos - m_buf);
-    int64_t elementSize  = elem.rowStride * elem.count;
+    int64_t elementSize  = int64_t(elem.rowStride) * skip;
     int64_t elementEnd   = elementStart + elementSize;
     if (elementEnd >= kPLYReadBufferSize)
     {
+      // The buffer ends where the file position is, unless the last
+      // refill was rewound to a safe character (never at EOF).
+      int64_t bufRead = m_atEOF ? int64_t(m_bufEnd - m_buf)
+                                : int64_t(kPLYReadBufferSize);
+      int64_t unread  = elementEnd - bufRead;
+
       m_bufOffset += elementEnd;
-      file_seek(m_f, m_bufOffset, SEEK_SET);
+      if (file_seek(m_f, m_bufOffset, SEEK_SET) != 0)
+      {
+        file_skip(m_f, unread, m_tmpBuf, kPLYTempBufferSize);
+      }
       m_bufEnd = m_buf + kPLYReadBufferSize;
       m_pos    = m_bufEnd;
       m_end    = m_bufEnd;
@@ -1030,6 +1411,26 @@ PLYElement *PLYReader::get_element(uint32_t idx)
   return (idx < num_elements()) ? &m_elements[idx] : nullptr;
 }
 
+int64_t PLYReader::file_offset() const
+{
+  return m_bufOffset + static_cast<int64_t>(m_pos - m_buf);
+}
+
+FILE *PLYReader::file_handle() const
+{
+  return m_f;
+}
+
+uint32_t PLYReader::num_comments() const
+{
+  return static_cast<uint32_t>(m_comments.size());
+}
+
+const char *PLYReader::get_comment(uint32_t idx) const
+{
+  return idx < m_comments.size() ? m_comments[idx].c_str() : nullptr;
+}
+
 bool PLYReader::element_is(const char *name) const
 {
   return has_element() && strcmp(element()->name.c_str(), name) == 0;
@@ -1739,8 +2140,9 @@ bool PLYReader::advance()
 
 bool PLYReader::next_line()
 {
-  m_pos = m_end;
-  do
+  m_pos                = m_end;
+  std::string *comment = nullptr;
+  while (true)
   {
     while (*m_pos != '\n')
     {
@@ -1753,11 +2155,36 @@ bool PLYReader::next_line()
         }
         return false;
       }
+      if (comment != nullptr && *m_pos != '\r')
+      {
+        comment->push_back(*m_pos);
+      }
       ++m_pos;
     }
     ++m_pos; // move past the newline char
-    m_end = m_pos;
-  } while (match("comment") || match("obj_info"));
+    m_end   = m_pos;
+    comment = nullptr;
+
+    if (match("obj_info"))
+    {
+      continue;
+    }
+    if (!match("comment"))
+    {
+      break;
+    }
+    // Keep the text of header comments, which may carry metadata.
+    if (!m_inDataSection)
+    {
+      m_pos = m_end;
+      while (*m_pos == ' ' || *m_pos == '\t')
+      {
+        ++m_pos;
+      }
+      m_comments.emplace_back();
+      comment = &m_comments.back();
+    }
+  }
 
   return true;
 }
@@ -1925,11 +2352,34 @@ bool PLYReader::load_fixed_size_element(PLYElement &elem)
 
   m_elementData.resize(numBytes);
 
+  if (m_fileType == PLYFileType::ASCII && elem.count > 0 &&
+      load_ascii_fixed_size_element(elem))
+  {
+    m_elementLoaded = true;
+    return true;
+  }
+  if (!load_fixed_size_rows(elem, elem.count))
+  {
+    return false;
+  }
+
+  m_elementLoaded = true;
+  return true;
+}
+
+// Reads `numRows` rows of a fixed-size element from the current
+// position into `m_elementData`, which must already have room for
+// them.
+bool PLYReader::load_fixed_size_rows(PLYElement &elem,
+                                     uint32_t    numRows)
+{
+  size_t numBytes = static_cast<size_t>(numRows) * elem.rowStride;
+
   if (m_fileType == PLYFileType::ASCII)
   {
     size_t back = 0;
 
-    for (uint32_t row = 0; row < elem.count; row++)
+    for (uint32_t row = 0; row < numRows; row++)
     {
       for (PLYProperty &prop : elem.properties)
       {
@@ -1974,7 +2424,7 @@ bool PLYReader::load_fixed_size_element(PLYElement &elem)
     if (m_fileType == PLYFileType::BinaryBigEndian)
     {
       uint8_t *data = m_elementData.data();
-      for (uint32_t row = 0; row < elem.count; row++)
+      for (uint32_t row = 0; row < numRows; row++)
       {
         for (PLYProperty &prop : elem.properties)
         {
@@ -1998,8 +2448,162 @@ bool PLYReader::load_fixed_size_element(PLYElement &elem)
       }
     }
   }
+  return true;
+}
 
-  m_elementLoaded = true;
+// Loads an ASCII element with one row per line by reading the body
+// in large chunks straight from the file, splitting each chunk at
+// newlines into one part per worker and parsing the parts in
+// parallel into their rows of `m_elementData`. Afterwards the read
+// buffer is repositioned at the line following the element. Returns
+// false if the data could not be read this way; the reader is then
+// left where it was, unless the body turned out to be malformed, in
+// which case it is also marked invalid.
+bool PLYReader::load_ascii_fixed_size_element(PLYElement &elem)
+{
+  // The read buffer ends where the file position is, unless the last
+  // refill was rewound to a safe character (never at EOF).
+  const char *bufferedEnd =
+      m_atEOF ? m_bufEnd : m_buf + kPLYReadBufferSize;
+  int64_t fileEnd = file_tell(m_f);
+  if (fileEnd < 0)
+  {
+    return false;
+  }
+  int64_t start = fileEnd - static_cast<int64_t>(bufferedEnd - m_pos);
+  if (file_seek(m_f, 0, SEEK_END) != 0)
+  {
+    return false;
+  }
+  // Small files get a chunk the size of what is left of them rather
+  // than a whole one; the extra byte lets the first read see the end.
+  int64_t left      = file_tell(m_f) - start;
+  size_t  chunkSize = kPLYAsciiChunkSize;
+  if (left < 0 || file_seek(m_f, start, SEEK_SET) != 0)
+  {
+    file_seek(m_f, fileEnd, SEEK_SET);
+    return false;
+  }
+  if (uint64_t(left) < chunkSize)
+  {
+    chunkSize = size_t(left) + 1;
+  }
+
+  std::vector<char>         chunk(chunkSize + 1);
+  std::vector<PLYAsciiPart> parts;
+  PLYAsciiJob               job      = {&elem, m_elementData.data(),
+                                        nullptr};
+  size_t                    carry    = 0;
+  int64_t                   consumed = 0;
+  uint32_t                  row      = 0;
+  bool                      ok       = true;
+  while (ok && row < elem.count)
+  {
+    size_t fetched =
+        fread(chunk.data() + carry, 1, chunkSize - carry, m_f);
+    size_t size = carry + fetched;
+    bool   eof  = fetched < chunkSize - carry;
+    if (eof && size > 0 && chunk[size - 1] != '\n')
+    {
+      chunk[size++] = '\n';
+    }
+    const char *base = chunk.data();
+    size_t      lines = size;
+    while (lines > 0 && base[lines - 1] != '\n')
+    {
+      --lines;
+    }
+    if (lines == 0)
+    {
+      // Either a line longer than a whole chunk or nothing left.
+      ok = false;
+      break;
+    }
+    const char *linesEnd = base + lines;
+
+    int         workers  = parallel_workers(
+        size_t(linesEnd - base), kPLYAsciiMinPart);
+    parts.assign(size_t(workers), PLYAsciiPart());
+    const char *partBegin = base;
+    for (int t = 0; t < workers; t++)
+    {
+      const char *partEnd = linesEnd;
+      if (t + 1 < workers)
+      {
+        partEnd = base + size_t(linesEnd - base) * size_t(t + 1) /
+                             size_t(workers);
+        if (partEnd < partBegin)
+        {
+          partEnd = partBegin;
+        }
+        const char *nl = static_cast<const char *>(std::memchr(
+            partEnd, '\n', size_t(linesEnd - partEnd)));
+        partEnd        = nl ? nl + 1 : linesEnd;
+      }
+      parts[size_t(t)].begin = partBegin;
+      parts[size_t(t)].end   = partEnd;
+      partBegin              = partEnd;
+    }
+    job.parts = parts.data();
+    parallel_for(parts.size(), workers, count_ascii_lines, &job);
+
+    // Assign rows to parts, dropping the lines past the element.
+    const char *chunkUsed = base;
+    for (PLYAsciiPart &part : parts)
+    {
+      uint32_t left = elem.count - row;
+      part.firstRow = row;
+      if (part.numRows >= left)
+      {
+        part.numRows = left;
+      }
+      row += part.numRows;
+      if (part.numRows > 0)
+      {
+        const char *pos = part.begin;
+        for (uint32_t i = 0; i < part.numRows; i++)
+        {
+          pos = static_cast<const char *>(std::memchr(
+                    pos, '\n', size_t(part.end - pos))) +
+                1;
+        }
+        chunkUsed = pos;
+      }
+    }
+    parallel_for(parts.size(), workers, parse_ascii_lines, &job);
+    for (const PLYAsciiPart &part : parts)
+    {
+      ok = ok && part.ok;
+    }
+
+    consumed += static_cast<int64_t>(chunkUsed - base);
+    carry = size - size_t(linesEnd - base);
+    std::memmove(chunk.data(), linesEnd, carry);
+    if (eof && row < elem.count)
+    {
+      ok = false;
+    }
+  }
+
+  if (!ok && consumed == 0 && row == 0)
+  {
+    // Nothing was taken from the file: go back to the generic path.
+    file_seek(m_f, fileEnd, SEEK_SET);
+    return false;
+  }
+
+  // Restart the read buffer at the line after the element.
+  m_bufOffset = start + consumed;
+  file_seek(m_f, m_bufOffset, SEEK_SET);
+  m_atEOF  = false;
+  m_bufEnd = m_buf + kPLYReadBufferSize;
+  m_pos    = m_bufEnd;
+  m_end    = m_bufEnd;
+  refill_buffer();
+  if (!ok)
+  {
+    m_valid = false;
+  }
   return true;
 }
 
@@ -2273,9 +2877,12 @@ bool PLYReader::ascii_value(PLYPropertyType propType,
     m_valid = int_literal(&tmpInt);
     break;
   case PLYPropertyType::Int:
-  case PLYPropertyType::UInt:
     m_valid = int_literal(reinterpret_cast<int *>(value));
     break;
+  case PLYPropertyType::UInt:
+    m_valid = miniply::uint_literal(
+        m_pos, &m_end, reinterpret_cast<uint32_t *>(value));
+    break;
   case PLYPropertyType::Float:
     m_valid = float_literal(reinterpret_cast<float *>(value));
     break;
@@ -0,0 +1,94 @@
+#define _POSIX_C_SOURCE 200809L
+#include <parallel.h>
+#include <pcprep/core.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static int thread_count_g = 0;
+
+typedef struct parallel_task_t
+{
+  parallel_func_t func;
+  void           *ctx;
+  size_t          begin;
+  size_t          end;
+  int             tid;
+  int             started;
+  pthread_t       thread;
+} parallel_task_t;
+
+static void *parallel_run(void *arg)
+{
+  parallel_task_t *task = (parallel_task_t *)arg;
+  task->func(task->ctx, task->begin, task->end, task->tid);
+  return NULL;
+}
+
+int get_thread_count(void)
+{
+  if (thread_count_g > 0)
+    return thread_count_g;
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  return online > 0 ? (int)online : 1;
+}
+
+void set_thread_count(int count)
+{
+  thread_count_g = count > 0 ? count : 0;
+}
+
+int parallel_workers(size_t n, size_t grain)
+{
+  size_t max     = (size_t)get_thread_count();
+  size_t workers = n / (grain > 0 ? grain : 1);
+  if (workers < 1)
+    workers = 1;
+  return (int)(workers < max ? workers : max);
+}
+
+void parallel_for(size_t          n,
+                  int             workers,
+                  parallel_func_t func,
+                  void           *ctx)
+{
+  if (workers <= 1)
+  {
+    func(ctx, 0, n, 0);
+    return;
+  }
+  parallel_task_t *tasks =
+      (parallel_task_t *)malloc(sizeof(parallel_task_t) * workers);
+  if (!tasks)
+  {
+    func(ctx, 0, n, 0);
+    return;
+  }
+  for (int t = 0; t < workers; t++)
+  {
+    tasks[t] = (parallel_task_t){
+        .func    = func,
+        .ctx     = ctx,
+        .begin   = n * (size_t)t / (size_t)workers,
+        .end     = n * (size_t)(t + 1) / (size_t)workers,
+        .tid     = t,
+        .started = 0};
+  }
+  for (int t = 1; t < workers; t++)
+  {
+    tasks[t].started = pthread_create(&tasks[t].thread,
+                                      NULL,
+                                      parallel_run,
+                                      &tasks[t]) == 0;
+  }
+  parallel_run(&tasks[0]);
+  for (int t = 1; t < workers; t++)
+  {
+    // a range whose thread could not be started runs here instead
+    if (tasks[t].started)
+      pthread_join(tasks[t].thread, NULL);
+    else
+      parallel_run(&tasks[t]);
+  }
+  free(tasks);
+}
@@ -1,404 +1,2973 @@
 #include "pcprep/pointcloud.h"
+#include "pcprep/aabb.h"
 #include "pcprep/core.h"
 #include "pcprep/vec3f.h"
 #include "pcprep/vec3uc.h"
 #include "pcprep/wrapper.h"
+#include <f2s.h>
+#include <gzpipe.h>
+#include <parallel.h>
+#include <fcntl.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
+// bytes in a binary PLY row: float x, y, z, uchar red, green, blue
+#define PCP_PLY_ROW_SIZE       15
+// number of points staged in memory per write by pointcloud_write
+#define PCP_WRITE_BLOCK_POINTS 0x40000
+// longest ASCII PLY row: 3 floats, 3 uchars, separators and newline
+#define PCP_ASCII_ROW_MAX      (3 * F2S_MAX_CHARS + 3 * 3 + 6)
+// highest bit depth of quantized positions, which read back exactly
+// as floats
+#define PCP_QUANT_MAX_BITS     24
+// number of points each thread formats per ASCII write round
+#define PCP_ASCII_BLOCK_POINTS 0x10000
+// points per cell of the grid of a farthest point sampling, the most
+// cells along an axis of it, and the points each thread updates at
+// least for a pick
+#define PCP_FPS_CELL_POINTS    32
+#define PCP_FPS_MAX_AXIS_CELLS 1024.0f
+#define PCP_FPS_MIN_POINTS     0x10000
+// colors of the cells of a Poisson disk sampling, cells along an
+// axis of its grid at most, and cells each thread handles at least
+#define PCP_POISSON_COLORS     8
+#define PCP_POISSON_MAX_CELLS  16777216.0f
+#define PCP_POISSON_MIN_CELLS  0x400
+// tries at finding a Poisson disk spacing for a number of points, and
+// the fraction of it by which the count found may be off
+#define PCP_POISSON_FIT_STEPS  8
+#define PCP_POISSON_FIT_SLACK  20
+// points each thread copies at least when merging or sampling
+// clouds
+#define PCP_MERGE_MIN_POINTS   0x40000
+// points converted to SoA at a time by the projection kernels
+#define PCP_SOA_BLOCK_POINTS   0x1000
+// points each thread buckets at least when tiling a cloud
+#define PCP_TILE_MIN_POINTS    0x10000
+// points each thread scans at least when finding bounds, and the
+// most threads doing it
+#define PCP_BOUNDS_MIN_POINTS  0x40000
+#define PCP_BOUNDS_MAX_WORKERS 64
+// digits of a radix sort pass, one byte of a key, and the points
+// each thread sorts at least
+#define PCP_SORT_RADIX         0x100
+#define PCP_SORT_MIN_POINTS    0x10000
+// points of a voxel up to which its median color is found by sorting
+// them rather than by a histogram
+#define PCP_VOXEL_SMALL_RUN    16
+// characters reserved for a vertex count patched after writing
+#define PCP_PLY_COUNT_WIDTH    10
+#define PCP_PCB_MAGIC          "PCB1"
+#define PCP_PCB_VERSION        1
+// alignment of the header and of the data blocks of a PCB file
+#define PCP_PCB_ALIGN          64
+#define PCP_PCT_MAGIC          "PCT1"
+#define PCP_PCT_VERSION        1
+
+typedef struct pcb_header_t
+{
+  char     magic[4];
+  uint32_t version;
+  uint64_t size;
+  uint64_t pos_offset;
+  uint64_t rgb_offset;
+  float    min[3];
+  float    max[3];
+  uint8_t  reserved[8];
+} pcb_header_t;
+
+// A PCT file holds the tiles of a cloud: this header, `count`
+// directory entries, then the data of each tile laid out like a PCB
+// file's at the offset of its entry.
+typedef struct pct_header_t
+{
+  char     magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint8_t  reserved[52];
+} pct_header_t;
+
+typedef struct pct_entry_t
+{
+  uint32_t id;
+  uint32_t reserved0;
+  uint64_t size;
+  uint64_t pos_offset;
+  uint64_t rgb_offset;
+  float    min[3];
+  float    max[3];
+  uint8_t  reserved[8];
+} pct_entry_t;
+
+#define PCP_QUANT_COMMENT "pcprep quantization"
+// Positions of a quantized cloud are `offset + q * scale` for
+// integers q in [0, 2^bits).
+typedef struct pointcloud_quant_t
+{
+  int   bits; // 0 for float positions
+  float offset[3];
+  float scale[3];
+} pointcloud_quant_t;
+
+static void ply_read_quant(ply_reader_t       *reader,
+                           pointcloud_quant_t *q)
+{
+  size_t len = strlen(PCP_QUANT_COMMENT);
+  q->bits    = 0;
+  for (int i = 0; i < ply_reader_count_comment(reader); i++)
+  {
+    const char *comment = ply_reader_comment(reader, i);
+    if (strncmp(comment, PCP_QUANT_COMMENT, len) != 0 ||
+        sscanf(comment + len,
+               "%d %f %f %f %f %f %f",
+               &q->bits,
+               &q->offset[0],
+               &q->offset[1],
+               &q->offset[2],
+               &q->scale[0],
+               &q->scale[1],
+               &q->scale[2]) != 7)
+    {
+      q->bits = 0;
+      continue;
+    }
+    return;
+  }
+}
+
+// Maps quantized positions, loaded as floats, back to coordinates.
+// A single pass of independent multiply-adds, which compilers turn
+// into SIMD code.
+static void pointcloud_dequantize(float                    *pos,
+                                  size_t                    size,
+                                  const pointcloud_quant_t *q)
+{
+  const float ox = q->offset[0], oy = q->offset[1], oz = q->offset[2];
+  const float sx = q->scale[0], sy = q->scale[1], sz = q->scale[2];
+  for (size_t i = 0; i < size; i++)
+  {
+    pos[i * 3]     = ox + pos[i * 3] * sx;
+    pos[i * 3 + 1] = oy + pos[i * 3 + 1] * sy;
+    pos[i * 3 + 2] = oz + pos[i * 3 + 2] * sz;
+  }
+}
+
+// Like pointcloud_init, but `rgb` is only allocated if `props`
+// has PCP_PROP_RGB.
+static int
+pointcloud_init_props(pointcloud_t *pc, size_t size, unsigned props)
+{
+  pc->size       = size;
+  pc->pos        = (float *)malloc(sizeof(float) * 3 * pc->size);
+  pc->rgb        = NULL;
+  pc->map        = NULL;
+  pc->map_size   = 0;
+  pc->arena      = NULL;
+  pc->view       = 0;
+  pc->has_bounds = 0;
+  if (props & PCP_PROP_RGB)
+    pc->rgb = (uint8_t *)malloc(sizeof(uint8_t) * 3 * pc->size);
+  return pc->size;
+}
 int pointcloud_init(pointcloud_t *pc, size_t size)
 {
-  pc->size = size;
-  pc->pos  = (float *)malloc(sizeof(float) * 3 * pc->size);
-  pc->rgb  = (uint8_t *)malloc(sizeof(uint8_t) * 3 * pc->size);
-  return pc->size;
+  return pointcloud_init_props(pc, size, PCP_PROP_ALL);
+}
+int pointcloud_free(pointcloud_t *pc)
+{
+  if (pc == NULL)
+    return 1;
+  pc->has_bounds = 0;
+  if (pc->arena || pc->view)
+  {
+    pc->arena = NULL;
+    pc->view  = 0;
+    pc->pos   = NULL;
+    pc->rgb   = NULL;
+    return 1;
+  }
+  if (pc->map)
+  {
+    munmap(pc->map, pc->map_size);
+    pc->map      = NULL;
+    pc->map_size = 0;
+    pc->pos      = NULL;
+    pc->rgb      = NULL;
+    return 1;
+  }
+  if (pc->pos)
+  {
+    free(pc->pos);
+    pc->pos = NULL;
+  }
+  if (pc->rgb)
+  {
+    free(pc->rgb);
+    pc->rgb = NULL;
+  }
+  return 1;
+}
+int pointcloud_load(pointcloud_t *pc, const char *filename)
+{
+  return pointcloud_load_props(pc, filename, PCP_PROP_ALL);
+}
+int pointcloud_load_props(pointcloud_t *pc,
+                          const char   *filename,
+                          unsigned      props)
+{
+  // A file that isn't a PLY may be a PCB, whose magic is checked
+  // once it is mapped.
+  ply_reader_t *reader = ply_reader_open(filename);
+  if (!reader)
+    return pointcloud_map_pcb(pc, filename, NULL);
+  pointcloud_quant_t quant;
+  ply_read_quant(reader, &quant);
+  pointcloud_init_props(pc, ply_reader_count_vertex(reader), props);
+  int ret = ply_reader_load_pointcloud(reader, pc->pos, pc->rgb);
+  if (ret && quant.bits > 0)
+    pointcloud_dequantize(pc->pos, pc->size, &quant);
+  ply_reader_close(reader);
+  return ret;
+}
+struct pointcloud_stream_t
+{
+  ply_reader_t      *reader;
+  size_t             size;
+  size_t             capacity; // points the last chunk can hold
+  pointcloud_quant_t quant;
+};
+pointcloud_stream_t *pointcloud_stream_open(const char *filename)
+{
+  ply_reader_t *reader = ply_reader_open(filename);
+  if (!reader)
+    return NULL;
+  int size = ply_reader_count_vertex(reader);
+  if (size < 0)
+  {
+    ply_reader_close(reader);
+    return NULL;
+  }
+  pointcloud_stream_t *stream =
+      (pointcloud_stream_t *)malloc(sizeof(pointcloud_stream_t));
+  stream->reader   = reader;
+  stream->size     = (size_t)size;
+  stream->capacity = 0;
+  ply_read_quant(reader, &stream->quant);
+  return stream;
+}
+size_t pointcloud_stream_size(pointcloud_stream_t *stream)
+{
+  return stream->size;
+}
+int pointcloud_stream_next_chunk(pointcloud_stream_t *stream,
+                                 size_t               max_points,
+                                 pointcloud_t        *chunk)
+{
+  if (max_points > stream->size)
+    max_points = stream->size;
+  if (chunk->pos == NULL || stream->capacity < max_points)
+  {
+    pointcloud_free(chunk);
+    pointcloud_init(chunk, max_points);
+    stream->capacity = max_points;
+  }
+  int ret = ply_reader_read_points(
+      stream->reader, max_points, chunk->pos, chunk->rgb);
+  chunk->size       = ret > 0 ? (size_t)ret : 0;
+  chunk->has_bounds = 0;
+  if (stream->quant.bits > 0)
+    pointcloud_dequantize(chunk->pos, chunk->size, &stream->quant);
+  return ret;
+}
+void pointcloud_stream_close(pointcloud_stream_t *stream)
+{
+  if (stream == NULL)
+    return;
+  ply_reader_close(stream->reader);
+  free(stream);
+}
+static uint64_t pcb_align(uint64_t offset)
+{
+  return (offset + PCP_PCB_ALIGN - 1) &
+         ~(uint64_t)(PCP_PCB_ALIGN - 1);
+}
+// Whether the `size` positions at `pos_offset` and colors at
+// `rgb_offset`, read from an untrusted header, fit in a file of
+// `file_size` bytes. Every point takes 15 bytes, which bounds the
+// size before it is multiplied, and the offsets are only subtracted
+// once ordered, so nothing can wrap.
+static int pcb_blocks_fit(uint64_t size,
+                          uint64_t pos_offset,
+                          uint64_t rgb_offset,
+                          uint64_t file_size)
+{
+  return pos_offset % PCP_PCB_ALIGN == 0 && size <= file_size / 15 &&
+         pos_offset <= rgb_offset && rgb_offset <= file_size &&
+         rgb_offset - pos_offset >= 12 * size &&
+         file_size - rgb_offset >= 3 * size;
+}
+int pointcloud_save_pcb(pointcloud_t pc, const char *filename)
+{
+  static const uint8_t zeros[PCP_PCB_ALIGN] = {0};
+  pcb_header_t         header               = {PCP_PCB_MAGIC};
+  aabb_t               b        = {{0, 0, 0}, {0, 0, 0}};
+  size_t               pos_size = sizeof(float) * 3 * pc.size;
+  FILE                *file     = fopen(filename, "wb");
+  if (!file)
+  {
+    perror("Error opening file");
+    return -1;
+  }
+  pointcloud_bounds(&pc, &b);
+  header.version    = PCP_PCB_VERSION;
+  header.size       = pc.size;
+  header.pos_offset = pcb_align(sizeof(pcb_header_t));
+  header.rgb_offset = pcb_align(header.pos_offset + pos_size);
+  header.min[0]     = b.min.x;
+  header.min[1]     = b.min.y;
+  header.min[2]     = b.min.z;
+  header.max[0]     = b.max.x;
+  header.max[1]     = b.max.y;
+  header.max[2]     = b.max.z;
+
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(pc.pos, 1, pos_size, file);
+  fwrite(zeros,
+         1,
+         header.rgb_offset - header.pos_offset - pos_size,
+         file);
+  if (pc.rgb)
+    fwrite(pc.rgb, 1, 3 * pc.size, file);
+  // a cloud without colors is saved black
+  for (size_t left = pc.rgb ? 0 : 3 * pc.size; left > 0;)
+  {
+    size_t n  = left < sizeof(zeros) ? left : sizeof(zeros);
+    left     -= fwrite(zeros, 1, n, file);
+    if (ferror(file))
+      break;
+  }
+  if (ferror(file) | fclose(file))
+    return -1;
+  return 0;
+}
+int pointcloud_map_pcb(pointcloud_t *pc,
+                       const char   *filename,
+                       aabb_t       *aabb)
+{
+  struct stat         st;
+  const pcb_header_t *header = NULL;
+  void               *map    = MAP_FAILED;
+  int                 fd     = open(filename, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) == 0 && st.st_size >= sizeof(pcb_header_t))
+    map = mmap(NULL,
+               st.st_size,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE,
+               fd,
+               0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+
+  header = (const pcb_header_t *)map;
+  if (memcmp(header->magic, PCP_PCB_MAGIC, 4) != 0 ||
+      header->version != PCP_PCB_VERSION ||
+      header->pos_offset < sizeof(pcb_header_t) ||
+      !pcb_blocks_fit(header->size,
+                      header->pos_offset,
+                      header->rgb_offset,
+                      (uint64_t)st.st_size))
+  {
+    munmap(map, st.st_size);
+    return 0;
+  }
+  pc->size       = header->size;
+  pc->pos        = (float *)((char *)map + header->pos_offset);
+  pc->rgb        = (uint8_t *)map + header->rgb_offset;
+  pc->map        = map;
+  pc->map_size   = st.st_size;
+  pc->arena      = NULL;
+  pc->view       = 0;
+  pc->has_bounds = header->size > 0;
+  pc->bounds     = (aabb_t){
+      {header->min[0], header->min[1], header->min[2]},
+      {header->max[0], header->max[1], header->max[2]}};
+  if (aabb)
+    *aabb = pc->bounds;
+  return 1;
+}
+
+typedef struct pct_write_ctx_t
+{
+  const pointcloud_t *tiles;
+  const pct_entry_t  *entries;
+  int                 fd;
+  int                 failed;
+} pct_write_ctx_t;
+
+static int pct_pwrite(int fd, const void *buf, size_t size, off_t at)
+{
+  const char *p = (const char *)buf;
+  while (size > 0)
+  {
+    ssize_t n = pwrite(fd, p, size, at);
+    if (n <= 0)
+      return -1;
+    p    += n;
+    at   += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+// Writes the data of tiles [begin, end) at their directory offsets.
+static void pct_write_tiles(void  *arg,
+                            size_t begin,
+                            size_t end,
+                            int    tid)
+{
+  pct_write_ctx_t *ctx = (pct_write_ctx_t *)arg;
+  for (size_t t = begin; t < end; t++)
+  {
+    const pointcloud_t *pc = &ctx->tiles[t];
+    const pct_entry_t  *e  = &ctx->entries[t];
+    if (pct_pwrite(ctx->fd,
+                   pc->pos,
+                   sizeof(float) * 3 * pc->size,
+                   (off_t)e->pos_offset) < 0 ||
+        pct_pwrite(ctx->fd,
+                   pc->rgb,
+                   3 * pc->size,
+                   (off_t)e->rgb_offset) < 0)
+      ctx->failed = 1;
+  }
+}
+
+int pointcloud_save_tiles(const pointcloud_t *tiles,
+                          int                 count,
+                          const char         *filename)
+{
+  pct_header_t    header  = {PCP_PCT_MAGIC};
+  pct_entry_t    *entries = NULL;
+  uint64_t        offset  = 0;
+  pct_write_ctx_t ctx     = {tiles, NULL, -1, 0};
+  if (count < 0)
+    return -1;
+  for (int t = 0; t < count; t++)
+    if (tiles[t].size > 0 && !tiles[t].rgb)
+      return -1;
+  entries = (pct_entry_t *)calloc(count + 1, sizeof(pct_entry_t));
+  if (!entries)
+    return -1;
+
+  // Lay the tiles out one after the other, each block aligned, so
+  // that every tile can be written and mapped independently.
+  header.version = PCP_PCT_VERSION;
+  header.count   = (uint32_t)count;
+  offset         = sizeof(pct_header_t) + sizeof(pct_entry_t) * count;
+  for (int t = 0; t < count; t++)
+  {
+    pointcloud_t tile = tiles[t];
+    aabb_t       b    = {{0, 0, 0}, {0, 0, 0}};
+    pointcloud_bounds(&tile, &b);
+    entries[t].id         = (uint32_t)t;
+    entries[t].size       = tiles[t].size;
+    entries[t].pos_offset = pcb_align(offset);
+    entries[t].rgb_offset =
+        pcb_align(entries[t].pos_offset + 12 * tiles[t].size);
+    entries[t].min[0]     = b.min.x;
+    entries[t].min[1]     = b.min.y;
+    entries[t].min[2]     = b.min.z;
+    entries[t].max[0]     = b.max.x;
+    entries[t].max[1]     = b.max.y;
+    entries[t].max[2]     = b.max.z;
+    offset                = entries[t].rgb_offset + 3 * tiles[t].size;
+  }
+
+  ctx.entries = entries;
+  ctx.fd      = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (ctx.fd < 0)
+  {
+    perror("Error opening file");
+    free(entries);
+    return -1;
+  }
+  // sizes the file up front, the gaps between blocks stay zero
+  if (ftruncate(ctx.fd, (off_t)offset) != 0 ||
+      pct_pwrite(ctx.fd, &header, sizeof(header), 0) < 0 ||
+      pct_pwrite(ctx.fd,
+                 entries,
+                 sizeof(pct_entry_t) * count,
+                 sizeof(header)) < 0)
+    ctx.failed = 1;
+  else
+    parallel_for(count,
+                 parallel_workers(count, 1),
+                 pct_write_tiles,
+                 &ctx);
+  if (close(ctx.fd) != 0)
+    ctx.failed = 1;
+  free(entries);
+  return ctx.failed ? -1 : 0;
+}
+
+// Reads the header of a PCT file and, if `entry` isn't NULL, the
+// directory entry of `tile`. Returns the number of tiles or -1.
+static int pct_read_entry(int fd, int tile, pct_entry_t *entry)
+{
+  pct_header_t header;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, PCP_PCT_MAGIC, 4) != 0 ||
+      header.version != PCP_PCT_VERSION || header.count > INT32_MAX)
+    return -1;
+  if (!entry)
+    return (int)header.count;
+  if (tile < 0 || tile >= (int)header.count ||
+      pread(fd,
+            entry,
+            sizeof(*entry),
+            sizeof(header) + sizeof(*entry) * (off_t)tile) !=
+          sizeof(*entry))
+    return -1;
+  return (int)header.count;
+}
+
+int pointcloud_count_tiles(const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  int count = pct_read_entry(fd, 0, NULL);
+  close(fd);
+  return count;
+}
+
+int pointcloud_map_tile(pointcloud_t *pc,
+                        const char   *filename,
+                        int           tile,
+                        aabb_t       *aabb)
+{
+  struct stat st;
+  pct_entry_t e;
+  void       *map   = MAP_FAILED;
+  uint64_t    page  = (uint64_t)sysconf(_SC_PAGESIZE);
+  uint64_t    start = 0;
+  uint64_t    end   = 0;
+  int         fd    = open(filename, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) != 0 || pct_read_entry(fd, tile, &e) < 0 ||
+      !pcb_blocks_fit(
+          e.size, e.pos_offset, e.rgb_offset, (uint64_t)st.st_size))
+  {
+    close(fd);
+    return 0;
+  }
+  // only the pages of this tile are mapped
+  start = e.pos_offset / page * page;
+  end   = e.rgb_offset + 3 * e.size;
+  if (end > start)
+    map = mmap(NULL,
+               end - start,
+               PROT_READ | PROT_WRITE,
+               MAP_PRIVATE,
+               fd,
+               (off_t)start);
+  close(fd);
+  if (e.size == 0)
+  {
+    if (map != MAP_FAILED)
+      munmap(map, end - start);
+    pointcloud_init(pc, 0);
+  }
+  else
+  {
+    if (map == MAP_FAILED)
+      return 0;
+    pc->size       = e.size;
+    pc->pos        = (float *)((char *)map + (e.pos_offset - start));
+    pc->rgb        = (uint8_t *)map + (e.rgb_offset - start);
+    pc->map        = map;
+    pc->map_size   = end - start;
+    pc->arena      = NULL;
+    pc->view       = 0;
+    pc->has_bounds = 1;
+    pc->bounds     = (aabb_t){{e.min[0], e.min[1], e.min[2]},
+                              {e.max[0], e.max[1], e.max[2]}};
+  }
+  if (aabb)
+  {
+    aabb->min = (vec3f_t){e.min[0], e.min[1], e.min[2]};
+    aabb->max = (vec3f_t){e.max[0], e.max[1], e.max[2]};
+  }
+  return 1;
+}
+
+// With `count_pos` set, the vertex count is padded with spaces to
+// PCP_PLY_COUNT_WIDTH characters and its offset is stored there, so
+// that it can be rewritten once the final count is known. With
+// `quant` set, positions are declared as integers of its bit depth
+// and its parameters are stored in a comment.
+static void ply_write_header(FILE                     *file,
+                             size_t                    size,
+                             int                       binary,
+                             long                     *count_pos,
+                             const pointcloud_quant_t *quant)
+{
+  const char *pos_type = "float";
+  fprintf(file,
+          "ply\n"
+          "format %s 1.0\n",
+          binary ? "binary_little_endian" : "ascii");
+  if (quant)
+  {
+    char values[6][F2S_MAX_CHARS + 1];
+    for (int j = 0; j < 3; j++)
+    {
+      values[j][f2s_buffered(quant->offset[j], values[j])]        = 0;
+      values[j + 3][f2s_buffered(quant->scale[j], values[j + 3])] = 0;
+    }
+    fprintf(file,
+            "comment " PCP_QUANT_COMMENT " %d %s %s %s %s %s %s\n",
+            quant->bits,
+            values[0],
+            values[1],
+            values[2],
+            values[3],
+            values[4],
+            values[5]);
+    pos_type = quant->bits <= 8    ? "uchar"
+               : quant->bits <= 16 ? "ushort"
+                                   : "uint";
+  }
+  fprintf(file, "element vertex ");
+  if (count_pos)
+  {
+    *count_pos = ftell(file);
+    fprintf(file, "%-*zu", PCP_PLY_COUNT_WIDTH, size);
+  }
+  else
+    fprintf(file, "%zu", size);
+  fprintf(file,
+          "\n"
+          "property %s x\n"
+          "property %s y\n"
+          "property %s z\n"
+          "property uchar red\n"
+          "property uchar green\n"
+          "property uchar blue\n"
+          "end_header\n",
+          pos_type,
+          pos_type,
+          pos_type);
+}
+
+// Packs `count` points into `dst` as binary PLY rows: 12 bytes of
+// x, y, z followed by 3 bytes of red, green, blue.
+static void pointcloud_interleave(const float   *pos,
+                                  const uint8_t *rgb,
+                                  size_t         count,
+                                  uint8_t       *dst)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    memcpy(dst, pos + i * 3, sizeof(float) * 3);
+    memcpy(dst + sizeof(float) * 3, rgb + i * 3, sizeof(uint8_t) * 3);
+    dst += PCP_PLY_ROW_SIZE;
+  }
+}
+
+static inline char *u8_to_str(char *p, uint8_t v)
+{
+  if (v >= 100)
+  {
+    *p++ = (char)('0' + v / 100);
+    v %= 100;
+    *p++ = (char)('0' + v / 10);
+  }
+  else if (v >= 10)
+  {
+    *p++ = (char)('0' + v / 10);
+  }
+  *p++ = (char)('0' + v % 10);
+  return p;
+}
+
+typedef struct pointcloud_ascii_ctx_t
+{
+  const float   *pos;
+  const uint8_t *rgb;
+  char         **bufs;
+  size_t        *lens;
+} pointcloud_ascii_ctx_t;
+
+// Formats points [begin, end) as ASCII PLY rows into the buffer of
+// worker `tid`.
+static void pointcloud_ascii_format(void  *arg,
+                                    size_t begin,
+                                    size_t end,
+                                    int    tid)
+{
+  pointcloud_ascii_ctx_t *ctx = (pointcloud_ascii_ctx_t *)arg;
+  char                   *p   = ctx->bufs[tid];
+  for (size_t i = begin; i < end; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      p += f2s_buffered(ctx->pos[i * 3 + j], p);
+      *p++ = ' ';
+    }
+    for (int j = 0; j < 3; j++)
+    {
+      p    = u8_to_str(p, ctx->rgb[i * 3 + j]);
+      *p++ = j < 2 ? ' ' : '\n';
+    }
+  }
+  ctx->lens[tid] = (size_t)(p - ctx->bufs[tid]);
+}
+
+// Writes the rows of `pc` as text. Each round, every worker formats
+// a contiguous range of up to PCP_ASCII_BLOCK_POINTS points into its
+// own buffer; the buffers are then written in worker order so the
+// file keeps the point order.
+static int pointcloud_write_ascii_body(pointcloud_t pc, FILE *file)
+{
+  int     workers = parallel_workers(pc.size, PCP_ASCII_BLOCK_POINTS);
+  size_t  round   = (size_t)workers * PCP_ASCII_BLOCK_POINTS;
+  char  **bufs    = (char **)calloc(workers, sizeof(char *));
+  size_t *lens    = (size_t *)calloc(workers, sizeof(size_t));
+  int     ret     = 0;
+  if (!bufs || !lens)
+  {
+    free(bufs);
+    free(lens);
+    return -1;
+  }
+  for (int t = 0; t < workers; t++)
+  {
+    bufs[t] =
+        (char *)malloc(PCP_ASCII_ROW_MAX * PCP_ASCII_BLOCK_POINTS);
+    if (!bufs[t])
+      ret = -1;
+  }
+
+  for (size_t i = 0; ret == 0 && i < pc.size; i += round)
+  {
+    size_t                 n   = pc.size - i < round ? pc.size - i
+                                                         : round;
+    pointcloud_ascii_ctx_t ctx = {
+        pc.pos + i * 3, pc.rgb + i * 3, bufs, lens};
+    parallel_for(n, workers, pointcloud_ascii_format, &ctx);
+    for (int t = 0; t < workers; t++)
+      fwrite(bufs[t], 1, lens[t], file);
+  }
+
+  for (int t = 0; t < workers; t++)
+    free(bufs[t]);
+  free(bufs);
+  free(lens);
+  return ret;
+}
+
+static int pointcloud_write_body(pointcloud_t pc,
+                                 FILE        *file,
+                                 int          binary)
+{
+  if (!pc.rgb && pc.size > 0)
+    return -1;
+  if (!binary)
+    return pointcloud_write_ascii_body(pc, file);
+
+  // Rows are staged in large blocks so that a frame takes a few
+  // multi-megabyte writes instead of two fwrite calls per point.
+  size_t   block = pc.size < PCP_WRITE_BLOCK_POINTS
+                       ? pc.size
+                       : PCP_WRITE_BLOCK_POINTS;
+  uint8_t *buf   = (uint8_t *)malloc(PCP_PLY_ROW_SIZE * block + 1);
+  if (!buf)
+    return -1;
+  for (size_t i = 0; i < pc.size; i += block)
+  {
+    size_t n = pc.size - i < block ? pc.size - i : block;
+    pointcloud_interleave(pc.pos + i * 3, pc.rgb + i * 3, n, buf);
+    fwrite(buf, PCP_PLY_ROW_SIZE, n, file);
+  }
+  free(buf);
+  return 0;
+}
+
+int pointcloud_write(pointcloud_t pc,
+                     const char  *filename,
+                     int          binary)
+{
+  gzpipe_t *out = gzpipe_open(filename, "wb");
+  if (!out)
+  {
+    perror("Error opening file");
+    return -1;
+  }
+
+  FILE *file = gzpipe_file(out);
+  ply_write_header(file, pc.size, binary, NULL, NULL);
+  if (pointcloud_write_body(pc, file, binary) < 0)
+  {
+    gzpipe_close(out);
+    return -1;
+  }
+
+  return gzpipe_close(out);
+}
+
+static inline char *u32_to_str(char *p, uint32_t v)
+{
+  char  tmp[10];
+  char *t = tmp;
+  do
+  {
+    *t++ = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (t > tmp)
+    *p++ = *--t;
+  return p;
+}
+
+// Writes the rows of `pc` with positions quantized as described by
+// `q`, PCP_WRITE_BLOCK_POINTS points per write.
+static int ply_write_quant_body(pointcloud_t              pc,
+                                FILE                     *file,
+                                int                       binary,
+                                const pointcloud_quant_t *q)
+{
+  uint32_t levels = (1u << q->bits) - 1;
+  size_t   width  = q->bits <= 8 ? 1 : q->bits <= 16 ? 2 : 4;
+  size_t   row    = binary ? 3 * width + 3 : 3 * 9 + 3 * 4;
+  char    *buf    = NULL;
+  float    inv[3];
+  if (!pc.rgb && pc.size > 0)
+    return -1;
+  buf = (char *)malloc(row * PCP_WRITE_BLOCK_POINTS);
+  if (!buf)
+    return -1;
+  for (int j = 0; j < 3; j++)
+    inv[j] = q->scale[j] > 0.0f ? 1.0f / q->scale[j] : 0.0f;
+
+  for (size_t i = 0; i < pc.size; i += PCP_WRITE_BLOCK_POINTS)
+  {
+    size_t n = pc.size - i < PCP_WRITE_BLOCK_POINTS
+                   ? pc.size - i
+                   : PCP_WRITE_BLOCK_POINTS;
+    char  *p = buf;
+    for (size_t k = i; k < i + n; k++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        float    v     = (pc.pos[k * 3 + j] - q->offset[j]) * inv[j];
+        uint32_t level = v <= 0.0f              ? 0
+                         : v >= (float)levels ? levels
+                                              : (uint32_t)(v + 0.5f);
+        if (!binary)
+        {
+          p    = u32_to_str(p, level);
+          *p++ = ' ';
+        }
+        else if (width == 1)
+          *p++ = (char)level;
+        else if (width == 2)
+        {
+          uint16_t q16 = (uint16_t)level;
+          memcpy(p, &q16, 2);
+          p += 2;
+        }
+        else
+        {
+          memcpy(p, &level, 4);
+          p += 4;
+        }
+      }
+      if (binary)
+      {
+        memcpy(p, pc.rgb + k * 3, 3);
+        p += 3;
+        continue;
+      }
+      for (int j = 0; j < 3; j++)
+      {
+        p    = u8_to_str(p, pc.rgb[k * 3 + j]);
+        *p++ = j < 2 ? ' ' : '\n';
+      }
+    }
+    fwrite(buf, 1, (size_t)(p - buf), file);
+  }
+  free(buf);
+  return 0;
+}
+
+int pointcloud_write_quantized(pointcloud_t pc,
+                               const char  *filename,
+                               int          binary,
+                               int          bits)
+{
+  pointcloud_quant_t quant = {bits, {0, 0, 0}, {0, 0, 0}};
+  aabb_t             b     = {{0, 0, 0}, {0, 0, 0}};
+  vec3f_t            min, max;
+  if (bits < 1 || bits > PCP_QUANT_MAX_BITS)
+    return -1;
+  pointcloud_bounds(&pc, &b);
+  min = b.min;
+  max = b.max;
+  quant.offset[0] = min.x;
+  quant.offset[1] = min.y;
+  quant.offset[2] = min.z;
+  quant.scale[0]  = (max.x - min.x) / (float)((1u << bits) - 1);
+  quant.scale[1]  = (max.y - min.y) / (float)((1u << bits) - 1);
+  quant.scale[2]  = (max.z - min.z) / (float)((1u << bits) - 1);
+
+  gzpipe_t *out   = gzpipe_open(filename, "wb");
+  if (!out)
+  {
+    perror("Error opening file");
+    return -1;
+  }
+  FILE *file = gzpipe_file(out);
+  ply_write_header(file, pc.size, binary, NULL, &quant);
+  if (ply_write_quant_body(pc, file, binary, &quant) < 0)
+  {
+    gzpipe_close(out);
+    return -1;
+  }
+  return gzpipe_close(out);
+}
+
+// Smallest box holding both `a` and `b`.
+static aabb_t aabb_union(aabb_t a, aabb_t b)
+{
+  return (aabb_t){{a.min.x < b.min.x ? a.min.x : b.min.x,
+                   a.min.y < b.min.y ? a.min.y : b.min.y,
+                   a.min.z < b.min.z ? a.min.z : b.min.z},
+                  {a.max.x > b.max.x ? a.max.x : b.max.x,
+                   a.max.y > b.max.y ? a.max.y : b.max.y,
+                   a.max.z > b.max.z ? a.max.z : b.max.z}};
+}
+
+// Bounds of `count` interleaved positions, `count` > 0. Each lane of
+// `lo` and `hi` follows one coordinate of one of PCP_SOA_WIDTH
+// consecutive points, so the inner loops become vector min and max.
+static void pos_bounds(const float *pos, size_t count, aabb_t *b)
+{
+  float  lo[3 * PCP_SOA_WIDTH];
+  float  hi[3 * PCP_SOA_WIDTH];
+  size_t whole = count / PCP_SOA_WIDTH * PCP_SOA_WIDTH;
+  for (int j = 0; j < 3 * PCP_SOA_WIDTH; j++)
+    lo[j] = hi[j] = pos[j % 3];
+  for (size_t i = 0; i < 3 * whole; i += 3 * PCP_SOA_WIDTH)
+  {
+    for (int j = 0; j < 3 * PCP_SOA_WIDTH; j++)
+    {
+      float a = pos[i + j];
+      lo[j]   = a < lo[j] ? a : lo[j];
+      hi[j]   = a > hi[j] ? a : hi[j];
+    }
+  }
+  for (size_t i = 3 * whole; i < 3 * count; i++)
+  {
+    lo[i % 3] = pos[i] < lo[i % 3] ? pos[i] : lo[i % 3];
+    hi[i % 3] = pos[i] > hi[i % 3] ? pos[i] : hi[i % 3];
+  }
+  for (int j = 3; j < 3 * PCP_SOA_WIDTH; j++)
+  {
+    lo[j % 3] = lo[j] < lo[j % 3] ? lo[j] : lo[j % 3];
+    hi[j % 3] = hi[j] > hi[j % 3] ? hi[j] : hi[j % 3];
+  }
+  b->min = (vec3f_t){lo[0], lo[1], lo[2]};
+  b->max = (vec3f_t){hi[0], hi[1], hi[2]};
+}
+
+typedef struct pointcloud_bounds_ctx_t
+{
+  const float *pos;
+  aabb_t      *bounds; // one per worker
+} pointcloud_bounds_ctx_t;
+
+static void
+pointcloud_bounds_range(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_bounds_ctx_t *ctx = (pointcloud_bounds_ctx_t *)arg;
+  pos_bounds(ctx->pos + 3 * begin, end - begin, &ctx->bounds[tid]);
+}
+
+int pointcloud_bounds(pointcloud_t *pc, aabb_t *aabb)
+{
+  if (!pc->pos || pc->size == 0)
+    return -1;
+  if (!pc->has_bounds)
+  {
+    aabb_t                  b[PCP_BOUNDS_MAX_WORKERS];
+    pointcloud_bounds_ctx_t ctx     = {pc->pos, b};
+    int                     workers = parallel_workers(
+        pc->size, PCP_BOUNDS_MIN_POINTS);
+    if (workers > PCP_BOUNDS_MAX_WORKERS)
+      workers = PCP_BOUNDS_MAX_WORKERS;
+    parallel_for(pc->size, workers, pointcloud_bounds_range, &ctx);
+    for (int t = 1; t < workers; t++)
+      b[0] = aabb_union(b[0], b[t]);
+    pc->bounds     = b[0];
+    pc->has_bounds = 1;
+  }
+  *aabb = pc->bounds;
+  return 0;
+}
+int pointcloud_invalidate_bounds(pointcloud_t *pc)
+{
+  pc->has_bounds = 0;
+  return 0;
+}
+
+int pointcloud_min(pointcloud_t pc, vec3f_t *min)
+{
+  aabb_t b;
+  pc.has_bounds = 0;
+  if (pointcloud_bounds(&pc, &b) < 0)
+    return -1;
+  *min = b.min;
+  return 0;
+}
+int pointcloud_max(pointcloud_t pc, vec3f_t *max)
+{
+  aabb_t b;
+  pc.has_bounds = 0;
+  if (pointcloud_bounds(&pc, &b) < 0)
+    return -1;
+  *max = b.max;
+  return 0;
+}
+
+int get_tile_id(vec3f_t n, vec3f_t min, vec3f_t max, vec3f_t v)
+{
+  if (v.x > max.x || v.y > max.y || v.z > max.z || v.x < min.x ||
+      v.y < min.y || v.z < min.z)
+    return -1;
+  vec3f_t ans;
+  // ans = (v - min) / ((max - min) / n);
+  // or ans = (v - min) * (invs(max - min) / n);
+  // or ans = (v - min) * (invs(max - min) * invs(n));
+  // or ans = (v - min) * invs(max - min) * n);
+  ans = vec3f_mul(vec3f_mul(vec3f_sub(v, min),
+                            vec3f_inverse(vec3f_sub(max, min))),
+                  n);
+  ans = (vec3f_t){(int)(ans.x < n.x ? ans.x : n.x - 1),
+                  (int)(ans.y < n.y ? ans.y : n.y - 1),
+                  (int)(ans.z < n.z ? ans.z : n.z - 1)};
+
+  return ans.z + ans.y * n.z + ans.x * n.y * n.z;
+}
+
+// Rounds `size` up to a multiple of PCP_SOA_WIDTH, at least one.
+static size_t soa_padded(size_t size)
+{
+  size_t n = (size + PCP_SOA_WIDTH - 1) / PCP_SOA_WIDTH;
+  return (n > 0 ? n : 1) * PCP_SOA_WIDTH;
+}
+
+// Fills the padding of `v` with its last value.
+static void soa_pad(float *v, size_t size)
+{
+  float last = size > 0 ? v[size - 1] : 0.0f;
+  for (size_t i = size; i < soa_padded(size); i++)
+    v[i] = last;
+}
+
+// Lane-wise minimum and maximum of `v`, whose length `n` is a
+// multiple of PCP_SOA_WIDTH. The lanes are independent, so the inner
+// loops become vector min and max.
+static void soa_min_max(const float *v,
+                        size_t       n,
+                        float       *min,
+                        float       *max)
+{
+  float lo[PCP_SOA_WIDTH];
+  float hi[PCP_SOA_WIDTH];
+  for (int j = 0; j < PCP_SOA_WIDTH; j++)
+    lo[j] = hi[j] = v[j];
+  for (size_t i = PCP_SOA_WIDTH; i < n; i += PCP_SOA_WIDTH)
+  {
+    for (int j = 0; j < PCP_SOA_WIDTH; j++)
+    {
+      float a = v[i + j];
+      lo[j]   = a < lo[j] ? a : lo[j];
+      hi[j]   = a > hi[j] ? a : hi[j];
+    }
+  }
+  *min = lo[0];
+  *max = hi[0];
+  for (int j = 1; j < PCP_SOA_WIDTH; j++)
+  {
+    *min = lo[j] < *min ? lo[j] : *min;
+    *max = hi[j] > *max ? hi[j] : *max;
+  }
+}
+
+// get_tile_id with `inv` = vec3f_inverse(b.max - b.min) computed by
+// the caller, branch-free. Indices are clamped before conversion so
+// points outside `b` convert safely too.
+static inline int grid_tile_id(
+    float x, float y, float z, vec3f_t n, aabb_t b, vec3f_t inv)
+{
+  float ax  = (x - b.min.x) * inv.x * n.x;
+  float ay  = (y - b.min.y) * inv.y * n.y;
+  float az  = (z - b.min.z) * inv.z * n.z;
+  int   out = x > b.max.x || y > b.max.y || z > b.max.z ||
+            x < b.min.x || y < b.min.y || z < b.min.z;
+
+  ax = ax < n.x ? ax : n.x - 1;
+  ay = ay < n.y ? ay : n.y - 1;
+  az = az < n.z ? az : n.z - 1;
+  ax = (float)(int)(ax > 0 ? ax : 0);
+  ay = (float)(int)(ay > 0 ? ay : 0);
+  az = (float)(int)(az > 0 ? az : 0);
+  return out ? -1 : (int)(az + ay * n.z + ax * n.y * n.z);
+}
+
+// get_tile_id over `count` points.
+static void soa_tile_ids(const float *restrict x,
+                         const float *restrict y,
+                         const float *restrict z,
+                         size_t                count,
+                         vec3f_t               n,
+                         aabb_t                b,
+                         int *restrict         ids)
+{
+  vec3f_t inv = vec3f_inverse(vec3f_sub(b.max, b.min));
+  for (size_t i = 0; i < count; i++)
+    ids[i] = grid_tile_id(x[i], y[i], z[i], n, b, inv);
+}
+
+// soa_tile_ids over interleaved positions.
+static void pos_tile_ids(const float *restrict pos,
+                         size_t                count,
+                         vec3f_t               n,
+                         aabb_t                b,
+                         int *restrict         ids)
+{
+  vec3f_t inv = vec3f_inverse(vec3f_sub(b.max, b.min));
+  for (size_t i = 0; i < count; i++)
+    ids[i] = grid_tile_id(
+        pos[3 * i], pos[3 * i + 1], pos[3 * i + 2], n, b, inv);
+}
+
+// vec3f_mvp_mul over `count` points.
+static void soa_project(const float *restrict x,
+                        const float *restrict y,
+                        const float *restrict z,
+                        size_t                count,
+                        const float          *mvp,
+                        float *restrict       nx,
+                        float *restrict       ny,
+                        float *restrict       nz)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    float tx =
+        mvp[0] * x[i] + mvp[4] * y[i] + mvp[8] * z[i] + mvp[12];
+    float ty =
+        mvp[1] * x[i] + mvp[5] * y[i] + mvp[9] * z[i] + mvp[13];
+    float tz =
+        mvp[2] * x[i] + mvp[6] * y[i] + mvp[10] * z[i] + mvp[14];
+    float tw =
+        mvp[3] * x[i] + mvp[7] * y[i] + mvp[11] * z[i] + mvp[15];
+    nx[i] = tx / tw;
+    ny[i] = ty / tw;
+    nz[i] = tz / tw;
+  }
+}
+
+int pointcloud_soa_init(pointcloud_soa_t *soa, size_t size)
+{
+  size_t bytes = sizeof(float) * soa_padded(size);
+  void  *x     = NULL;
+  void  *y     = NULL;
+  void  *z     = NULL;
+  soa->rgb     = NULL;
+  soa->size    = size;
+  if (posix_memalign(&x, PCP_SOA_WIDTH * sizeof(float), bytes) ||
+      posix_memalign(&y, PCP_SOA_WIDTH * sizeof(float), bytes) ||
+      posix_memalign(&z, PCP_SOA_WIDTH * sizeof(float), bytes))
+  {
+    free(x);
+    free(y);
+    soa->x = soa->y = soa->z = NULL;
+    return -1;
+  }
+  soa->x = (float *)x;
+  soa->y = (float *)y;
+  soa->z = (float *)z;
+  soa_pad(soa->x, 0);
+  soa_pad(soa->y, 0);
+  soa_pad(soa->z, 0);
+  return 0;
+}
+int pointcloud_soa_free(pointcloud_soa_t *soa)
+{
+  if (soa == NULL)
+    return 0;
+  free(soa->x);
+  free(soa->y);
+  free(soa->z);
+  free(soa->rgb);
+  *soa = (pointcloud_soa_t){NULL, NULL, NULL, NULL, 0};
+  return 1;
+}
+int pointcloud_to_soa(pointcloud_t pc, pointcloud_soa_t *soa)
+{
+  if (pointcloud_soa_init(soa, pc.size) < 0)
+    return -1;
+  for (size_t i = 0; i < pc.size; i++)
+  {
+    soa->x[i] = pc.pos[3 * i];
+    soa->y[i] = pc.pos[3 * i + 1];
+    soa->z[i] = pc.pos[3 * i + 2];
+  }
+  soa_pad(soa->x, pc.size);
+  soa_pad(soa->y, pc.size);
+  soa_pad(soa->z, pc.size);
+  if (pc.rgb)
+  {
+    soa->rgb = (uint8_t *)malloc(3 * pc.size + 1);
+    if (!soa->rgb)
+    {
+      pointcloud_soa_free(soa);
+      return -1;
+    }
+    memcpy(soa->rgb, pc.rgb, 3 * pc.size);
+  }
+  return 0;
+}
+int pointcloud_from_soa(pointcloud_soa_t soa, pointcloud_t *pc)
+{
+  pointcloud_init_props(
+      pc, soa.size, soa.rgb ? PCP_PROP_ALL : PCP_PROP_POS);
+  if (!pc->pos || (soa.rgb && !pc->rgb))
+  {
+    pointcloud_free(pc);
+    return -1;
+  }
+  for (size_t i = 0; i < soa.size; i++)
+  {
+    pc->pos[3 * i]     = soa.x[i];
+    pc->pos[3 * i + 1] = soa.y[i];
+    pc->pos[3 * i + 2] = soa.z[i];
+  }
+  if (soa.rgb)
+    memcpy(pc->rgb, soa.rgb, 3 * soa.size);
+  return 0;
+}
+int pointcloud_soa_bounds(pointcloud_soa_t soa, aabb_t *aabb)
+{
+  if (!soa.x || soa.size == 0)
+    return -1;
+  size_t n = soa_padded(soa.size);
+  soa_min_max(soa.x, n, &aabb->min.x, &aabb->max.x);
+  soa_min_max(soa.y, n, &aabb->min.y, &aabb->max.y);
+  soa_min_max(soa.z, n, &aabb->min.z, &aabb->max.z);
+  return 0;
+}
+int pointcloud_soa_tile_ids(pointcloud_soa_t soa,
+                            vec3f_t          n,
+                            aabb_t           aabb,
+                            int             *ids)
+{
+  if (!soa.x)
+    return -1;
+  soa_tile_ids(soa.x, soa.y, soa.z, soa.size, n, aabb, ids);
+  return 0;
+}
+int pointcloud_soa_project(pointcloud_soa_t  soa,
+                           const float      *mvp,
+                           pointcloud_soa_t *ndc)
+{
+  if (!soa.x || !ndc->x || ndc->size < soa.size)
+    return -1;
+  // the padding is projected too, which keeps the loop whole
+  soa_project(soa.x,
+              soa.y,
+              soa.z,
+              soa_padded(soa.size),
+              mvp,
+              ndc->x,
+              ndc->y,
+              ndc->z);
+  return 0;
+}
+
+int pointcloud_arena_init(pointcloud_arena_t *arena, size_t capacity)
+{
+  *arena = (pointcloud_arena_t){NULL, NULL, 0, 0};
+  return pointcloud_arena_reset(arena, capacity);
+}
+
+int pointcloud_arena_reset(pointcloud_arena_t *arena, size_t capacity)
+{
+  arena->used = 0;
+  if (capacity <= arena->capacity)
+    return 0;
+  float *pos =
+      (float *)realloc(arena->pos, sizeof(float) * 3 * capacity);
+  if (pos)
+    arena->pos = pos;
+  uint8_t *rgb = (uint8_t *)realloc(arena->rgb, 3 * capacity);
+  if (rgb)
+    arena->rgb = rgb;
+  if (!pos || !rgb)
+    return -1;
+  arena->capacity = capacity;
+  return 0;
+}
+
+int pointcloud_arena_free(pointcloud_arena_t *arena)
+{
+  if (arena == NULL)
+    return 1;
+  free(arena->pos);
+  free(arena->rgb);
+  *arena = (pointcloud_arena_t){NULL, NULL, 0, 0};
+  return 1;
+}
+
+int pointcloud_arena_alloc(pointcloud_arena_t *arena,
+                           size_t              size,
+                           pointcloud_t       *pc)
+{
+  if (size > arena->capacity - arena->used)
+    return -1;
+  pc->size       = size;
+  pc->pos        = arena->pos + 3 * arena->used;
+  pc->rgb        = arena->rgb + 3 * arena->used;
+  pc->map        = NULL;
+  pc->map_size   = 0;
+  pc->arena      = arena;
+  pc->view       = 0;
+  pc->has_bounds = 0;
+  arena->used   += size;
+  return 0;
+}
+
+// State shared by the workers that bucket the points of `pc` into a
+// grid of n.x * n.y * n.z tiles spanning `b`.
+typedef struct pointcloud_tile_ctx_t
+{
+  pointcloud_t  pc;
+  vec3f_t       n;
+  aabb_t        b;
+  int           size;
+  // tile of every point, cached between the passes, or NULL
+  int          *ids;
+  // `size` entries per worker: its point count in every tile, then
+  // the index in the tile where the worker's first point there goes
+  size_t       *counts;
+  // `size` entries per worker: its bounds of every tile, or NULL
+  aabb_t       *aabbs;
+  pointcloud_t *tiles;
+} pointcloud_tile_ctx_t;
+
+// Counts the points of [begin, end) per tile in the histogram of
+// worker `tid`, and grows its tile bounds if asked to.
+static void
+pointcloud_tile_count(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_tile_ctx_t *ctx    = (pointcloud_tile_ctx_t *)arg;
+  size_t                 first  = (size_t)tid * ctx->size;
+  size_t                *counts = ctx->counts + first;
+  aabb_t                *aabbs  = ctx->aabbs;
+  int                    block[PCP_SOA_BLOCK_POINTS];
+  if (aabbs)
+    aabbs += first;
+  for (size_t b = begin; b < end; b += PCP_SOA_BLOCK_POINTS)
+  {
+    size_t n   = end - b;
+    int   *ids = ctx->ids ? ctx->ids + b : block;
+    if (n > PCP_SOA_BLOCK_POINTS)
+      n = PCP_SOA_BLOCK_POINTS;
+    pos_tile_ids(ctx->pc.pos + 3 * b, n, ctx->n, ctx->b, ids);
+    for (size_t i = 0; i < n; i++)
+    {
+      vec3f_t v = ((vec3f_t *)ctx->pc.pos)[b + i];
+      int     t = ids[i];
+      if (aabbs && counts[t] == 0)
+        aabbs[t] = (aabb_t){v, v};
+      else if (aabbs)
+        aabbs[t] = aabb_union(aabbs[t], (aabb_t){v, v});
+      counts[t]++;
+    }
+  }
+}
+
+// Copies the points of [begin, end) to their tiles, from the index
+// that the prefix sum reserved for worker `tid` in each of them.
+static void
+pointcloud_tile_scatter(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_tile_ctx_t *ctx = (pointcloud_tile_ctx_t *)arg;
+  size_t *next = ctx->counts + (size_t)tid * ctx->size;
+  for (size_t i = begin; i < end; i++)
+  {
+    pointcloud_t *tile = &ctx->tiles[ctx->ids[i]];
+    size_t        j    = next[ctx->ids[i]]++;
+    memcpy(tile->pos + 3 * j, ctx->pc.pos + 3 * i, 3 * sizeof(float));
+    if (ctx->pc.rgb)
+      memcpy(tile->rgb + 3 * j, ctx->pc.rgb + 3 * i, 3);
+  }
+}
+
+// Buckets the points of `pc` by tile in parallel: every worker
+// counts its share of the points per tile, a prefix sum over the
+// workers gives each of them where to write in every tile, and the
+// workers then copy their points there, so the points of a tile keep
+// their order. The tiles are given their own allocations, or carved
+// from `arena` if it isn't NULL.
+static int pointcloud_tile_into(pointcloud_t        pc,
+                                int                 n_x,
+                                int                 n_y,
+                                int                 n_z,
+                                pointcloud_arena_t *arena,
+                                pointcloud_t      **tiles)
+{
+  pointcloud_tile_ctx_t ctx     = {pc, (vec3f_t){n_x, n_y, n_z}};
+  int                   size    = n_x * n_y * n_z;
+  int                   workers = parallel_workers(
+      pc.size, PCP_TILE_MIN_POINTS);
+
+  ctx.size   = size;
+  ctx.ids    = (int *)malloc(sizeof(int) * (pc.size + 1));
+  ctx.counts = (size_t *)calloc(
+      (size_t)workers * size, sizeof(size_t));
+  *tiles     = (pointcloud_t *)malloc(sizeof(pointcloud_t) * size);
+
+  if (!ctx.ids || !ctx.counts || !*tiles ||
+      (arena && pointcloud_arena_reset(arena, pc.size) < 0))
+  {
+    free(ctx.ids);
+    free(ctx.counts);
+    free(*tiles);
+    *tiles = NULL;
+    return -1;
+  }
+
+  // A stale cache would give points outside the grid, so the bounds
+  // are found again.
+  pc.has_bounds = 0;
+  pointcloud_bounds(&pc, &ctx.b);
+  parallel_for(pc.size, workers, pointcloud_tile_count, &ctx);
+
+  for (int t = 0; t < size; t++)
+  {
+    size_t total = 0;
+    for (int w = 0; w < workers; w++)
+    {
+      size_t *count = &ctx.counts[(size_t)w * size + t];
+      size_t  n     = *count;
+      *count        = total;
+      total        += n;
+    }
+    if (arena)
+    {
+      pointcloud_arena_alloc(arena, total, &(*tiles)[t]);
+      if (!pc.rgb)
+        (*tiles)[t].rgb = NULL;
+    }
+    else
+      pointcloud_init_props(&(*tiles)[t],
+                            total,
+                            pc.rgb ? PCP_PROP_ALL : PCP_PROP_POS);
+  }
+
+  ctx.tiles = *tiles;
+  parallel_for(pc.size, workers, pointcloud_tile_scatter, &ctx);
+
+  free(ctx.ids);
+  free(ctx.counts);
+
+  return size;
+}
+
+// TODO: this function is not safe
+int pointcloud_tile(
+    pointcloud_t pc, int n_x, int n_y, int n_z, pointcloud_t **tiles)
+{
+  return pointcloud_tile_into(pc, n_x, n_y, n_z, NULL, tiles);
+}
+
+int pointcloud_tile_arena(pointcloud_t        pc,
+                          int                 n_x,
+                          int                 n_y,
+                          int                 n_z,
+                          pointcloud_arena_t *arena,
+                          pointcloud_t      **tiles)
+{
+  return pointcloud_tile_into(pc, n_x, n_y, n_z, arena, tiles);
+}
+
+static void
+pointcloud_swap_points(pointcloud_t pc, size_t i, size_t j)
+{
+  for (int k = 0; k < 3; k++)
+  {
+    float p            = pc.pos[3 * i + k];
+    pc.pos[3 * i + k]  = pc.pos[3 * j + k];
+    pc.pos[3 * j + k]  = p;
+    if (pc.rgb)
+    {
+      uint8_t c         = pc.rgb[3 * i + k];
+      pc.rgb[3 * i + k] = pc.rgb[3 * j + k];
+      pc.rgb[3 * j + k] = c;
+    }
+  }
+}
+
+int pointcloud_partition(pointcloud_t  *pc,
+                         int            n_x,
+                         int            n_y,
+                         int            n_z,
+                         pointcloud_t **tiles,
+                         aabb_t        *aabbs)
+{
+  pointcloud_tile_ctx_t ctx     = {*pc, (vec3f_t){n_x, n_y, n_z}};
+  int                   size    = n_x * n_y * n_z;
+  int                   workers = parallel_workers(
+      pc->size, PCP_TILE_MIN_POINTS);
+  size_t *next = (size_t *)malloc(sizeof(size_t) * size);
+  vec3f_t inv;
+
+  ctx.size   = size;
+  ctx.counts = (size_t *)calloc(
+      (size_t)workers * size, sizeof(size_t));
+  ctx.aabbs  = aabbs ? (aabb_t *)malloc(
+                          sizeof(aabb_t) * (size_t)workers * size)
+                     : NULL;
+  *tiles     = (pointcloud_t *)malloc(sizeof(pointcloud_t) * size);
+  if (!next || !ctx.counts || (aabbs && !ctx.aabbs) || !*tiles)
+  {
+    free(next);
+    free(ctx.counts);
+    free(ctx.aabbs);
+    free(*tiles);
+    *tiles = NULL;
+    return -1;
+  }
+
+  // The tile sizes and bounds are counted in parallel; the points are
+  // then moved serially, as that needs no copy of the cloud. The
+  // bounds are found again, as a stale cache would give points
+  // outside the grid.
+  pointcloud_invalidate_bounds(pc);
+  pointcloud_bounds(pc, &ctx.b);
+  parallel_for(pc->size, workers, pointcloud_tile_count, &ctx);
+
+  // Each tile is a view at its offset in the reordered cloud.
+  size_t offset = 0;
+  for (int t = 0; t < size; t++)
+  {
+    (*tiles)[t] = (pointcloud_t){NULL, NULL, 0};
+    if (aabbs)
+      aabbs[t] = (aabb_t){{0, 0, 0}, {0, 0, 0}};
+    for (int w = 0; w < workers; w++)
+    {
+      size_t  count = ctx.counts[(size_t)w * size + t];
+      aabb_t *a     = ctx.aabbs ? &ctx.aabbs[(size_t)w * size + t]
+                                : NULL;
+      if (a && count > 0 && (*tiles)[t].size == 0)
+        aabbs[t] = *a;
+      else if (a && count > 0)
+        aabbs[t] = aabb_union(aabbs[t], *a);
+      (*tiles)[t].size += count;
+    }
+    (*tiles)[t].pos  = pc->pos + 3 * offset;
+    (*tiles)[t].rgb  = pc->rgb ? pc->rgb + 3 * offset : NULL;
+    (*tiles)[t].view = 1;
+    if (aabbs)
+    {
+      (*tiles)[t].bounds     = aabbs[t];
+      (*tiles)[t].has_bounds = (*tiles)[t].size > 0;
+    }
+    next[t]          = offset;
+    offset          += (*tiles)[t].size;
+  }
+
+  // Swap every point into the next free slot of its tile until the
+  // slot holds a point of the tile it belongs to, so each point
+  // moves once.
+  offset = 0;
+  inv    = vec3f_inverse(vec3f_sub(ctx.b.max, ctx.b.min));
+  for (int t = 0; t < size; t++)
+  {
+    offset += (*tiles)[t].size;
+    while (next[t] < offset)
+    {
+      float *p = pc->pos + 3 * next[t];
+      int    d = grid_tile_id(p[0], p[1], p[2], ctx.n, ctx.b, inv);
+      if (d == t)
+        next[t]++;
+      else
+        pointcloud_swap_points(*pc, next[t], next[d]++);
+    }
+  }
+
+  free(next);
+  free(ctx.counts);
+  free(ctx.aabbs);
+  return size;
+}
+
+typedef struct pointcloud_tile_writer_t
+{
+  FILE  *file;
+  long   count_pos;
+  size_t size;
+} pointcloud_tile_writer_t;
+
+static int pointcloud_stream_bounds(const char *filename,
+                                    size_t      chunk_points,
+                                    aabb_t     *aabb)
+{
+  pointcloud_stream_t *stream = pointcloud_stream_open(filename);
+  pointcloud_t         chunk  = {NULL, NULL, 0};
+  int                  first  = 1;
+  int                  n      = 0;
+  if (!stream)
+    return -1;
+  while ((n = pointcloud_stream_next_chunk(
+              stream, chunk_points, &chunk)) > 0)
+  {
+    aabb_t b;
+    pointcloud_bounds(&chunk, &b);
+    *aabb = first ? b : aabb_union(*aabb, b);
+    first = 0;
+  }
+  pointcloud_free(&chunk);
+  pointcloud_stream_close(stream);
+  return n < 0 || first ? -1 : 0;
+}
+
+int pointcloud_tile_stream(const char   *filename,
+                           int           n_x,
+                           int           n_y,
+                           int           n_z,
+                           const aabb_t *aabb,
+                           size_t        chunk_points,
+                           const char   *output_path,
+                           int           binary)
+{
+  aabb_t                    bounds;
+  vec3f_t                   n      = (vec3f_t){n_x, n_y, n_z};
+  int                       size   = n_x * n_y * n_z;
+  int                       ret    = size;
+  int                       read   = 0;
+  pointcloud_stream_t      *stream = NULL;
+  pointcloud_t              chunk  = {NULL, NULL, 0};
+  pointcloud_t              sorted = {NULL, NULL, 0};
+  pointcloud_tile_writer_t *tiles  = NULL;
+  int                      *ids    = NULL;
+  size_t                   *offset = NULL;
+  char                      path[4096];
+
+  size_t len = strlen(output_path);
+  if (size <= 0 || chunk_points == 0 ||
+      (len > 3 && strcmp(output_path + len - 3, ".gz") == 0))
+    return -1;
+  if (aabb)
+    bounds = *aabb;
+  else if (pointcloud_stream_bounds(filename, chunk_points, &bounds) <
+           0)
+    return -1;
+
+  stream = pointcloud_stream_open(filename);
+  tiles  = (pointcloud_tile_writer_t *)calloc(
+      size, sizeof(pointcloud_tile_writer_t));
+  ids    = (int *)malloc(sizeof(int) * chunk_points);
+  offset = (size_t *)malloc(sizeof(size_t) * (size + 1));
+  if (!stream || !tiles || !ids || !offset ||
+      pointcloud_init(&sorted, chunk_points) < 0)
+  {
+    ret = -1;
+    goto cleanup;
+  }
+  for (int t = 0; t < size; t++)
+  {
+    snprintf(path, sizeof(path), output_path, t);
+    tiles[t].file = fopen(path, "wb");
+    if (!tiles[t].file)
+    {
+      perror("Error opening file");
+      ret = -1;
+      goto cleanup;
+    }
+    ply_write_header(
+        tiles[t].file, 0, binary, &tiles[t].count_pos, NULL);
+  }
+
+  // Each chunk is bucketed by tile with a counting sort, then every
+  // bucket is appended to its tile's file.
+  while ((read = pointcloud_stream_next_chunk(
+              stream, chunk_points, &chunk)) > 0)
+  {
+    memset(offset, 0, sizeof(size_t) * (size + 1));
+    pos_tile_ids(chunk.pos, chunk.size, n, bounds, ids);
+    for (size_t i = 0; i < chunk.size; i++)
+    {
+      if (ids[i] >= 0)
+        offset[ids[i] + 1]++;
+    }
+    for (int t = 0; t < size; t++)
+      offset[t + 1] += offset[t];
+    for (size_t i = 0; i < chunk.size; i++)
+    {
+      if (ids[i] < 0)
+        continue;
+      size_t j = offset[ids[i]]++;
+      memcpy(
+          sorted.pos + j * 3, chunk.pos + i * 3, sizeof(float) * 3);
+      memcpy(sorted.rgb + j * 3, chunk.rgb + i * 3, 3);
+    }
+    // offset[t] now is the end of bucket t, i.e. the start of t + 1
+    for (int t = 0; t < size; t++)
+    {
+      size_t       begin = t == 0 ? 0 : offset[t - 1];
+      pointcloud_t part  = {sorted.pos + begin * 3,
+                            sorted.rgb + begin * 3,
+                            offset[t] - begin};
+      if (part.size == 0)
+        continue;
+      if (pointcloud_write_body(part, tiles[t].file, binary) < 0)
+      {
+        ret = -1;
+        goto cleanup;
+      }
+      tiles[t].size += part.size;
+    }
+  }
+  if (read < 0)
+    ret = -1;
+
+cleanup:
+  for (int t = 0; tiles && t < size; t++)
+  {
+    if (!tiles[t].file)
+      continue;
+    fseek(tiles[t].file, tiles[t].count_pos, SEEK_SET);
+    fprintf(
+        tiles[t].file, "%-*zu", PCP_PLY_COUNT_WIDTH, tiles[t].size);
+    if (fclose(tiles[t].file) != 0)
+      ret = -1;
+  }
+  free(tiles);
+  free(ids);
+  free(offset);
+  pointcloud_free(&sorted);
+  pointcloud_free(&chunk);
+  pointcloud_stream_close(stream);
+  return ret;
+}
+
+typedef struct pointcloud_merge_ctx_t
+{
+  const pointcloud_t *pcs;
+  size_t              count;
+  const size_t       *offset; // first point of each input in `out`
+  pointcloud_t       *out;
+} pointcloud_merge_ctx_t;
+
+// Copies points [begin, end) of the merged cloud from the inputs
+// they come from.
+static void pointcloud_merge_copy(void  *arg,
+                                  size_t begin,
+                                  size_t end,
+                                  int    tid)
+{
+  pointcloud_merge_ctx_t *ctx = (pointcloud_merge_ctx_t *)arg;
+  size_t                  lo  = 0;
+  size_t                  hi  = ctx->count;
+  // last input starting at or before `begin`
+  while (hi - lo > 1)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (ctx->offset[mid] <= begin)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  for (size_t i = lo; i < ctx->count && begin < end; i++)
+  {
+    size_t from = begin - ctx->offset[i];
+    size_t n    = ctx->offset[i + 1] - begin;
+    if (n > end - begin)
+      n = end - begin;
+    if (n == 0)
+      continue;
+    memcpy((char *)(ctx->out->pos + begin * 3),
+           (char *)(ctx->pcs[i].pos + from * 3),
+           n * 3 * sizeof(float));
+    if (ctx->out->rgb)
+      memcpy((char *)(ctx->out->rgb + begin * 3),
+             (char *)(ctx->pcs[i].rgb + from * 3),
+             n * 3 * sizeof(uint8_t));
+    begin += n;
+  }
+}
+
+int pointcloud_merge(pointcloud_t *pcs,
+                     size_t        pc_count,
+                     pointcloud_t *out)
+{
+  unsigned props = PCP_PROP_ALL;
+  size_t  *offset =
+      (size_t *)malloc(sizeof(size_t) * (pc_count + 1));
+  if (!offset)
+    return -1;
+  offset[0] = 0;
+  for (size_t i = 0; i < pc_count; i++)
+  {
+    offset[i + 1] = offset[i] + pcs[i].size;
+    // an empty input has no colors only for lack of points
+    if (!pcs[i].rgb && pcs[i].size > 0)
+      props = PCP_PROP_POS;
+  }
+  if (pointcloud_init_props(out, offset[pc_count], props) < 0)
+  {
+    free(offset);
+    return -1; // Memory allocation failed
+  }
+
+  // Each worker copies an equal share of the output points, which
+  // may span several inputs or part of one.
+  pointcloud_merge_ctx_t ctx     = {pcs, pc_count, offset, out};
+  int                    workers = parallel_workers(
+      offset[pc_count], PCP_MERGE_MIN_POINTS);
+  parallel_for(
+      offset[pc_count], workers, pointcloud_merge_copy, &ctx);
+  free(offset);
+
+  // The bounds come for free if every input has them, as with tiles
+  // mapped from a container.
+  for (size_t i = 0; i < pc_count; i++)
+  {
+    if (pcs[i].size == 0)
+      continue;
+    if (!pcs[i].has_bounds)
+    {
+      out->has_bounds = 0;
+      break;
+    }
+    out->bounds     = out->has_bounds
+                          ? aabb_union(out->bounds, pcs[i].bounds)
+                          : pcs[i].bounds;
+    out->has_bounds = 1;
+  }
+  return 1;
+}
+
+// A point's position as three integers that sort like vec3f_l, and
+// the index of the point.
+typedef struct pointcloud_sort_rec_t
+{
+  uint32_t key[3];
+  uint32_t index;
+} pointcloud_sort_rec_t;
+
+// Maps `f` to an integer of the same order. -0 and +0 map alike, so
+// that keys are equal exactly when vec3f_eq holds.
+static uint32_t float_sort_key(float f)
+{
+  uint32_t u;
+  f += 0.0f;
+  memcpy(&u, &f, sizeof(u));
+  return (u & 0x80000000u) ? ~u : u | 0x80000000u;
+}
+
+// State of one pass of the radix sort, which orders the records of
+// `src` into `dst` by the byte at `shift` of key word `word`.
+typedef struct pointcloud_sort_ctx_t
+{
+  const float           *pos;
+  pointcloud_sort_rec_t *src;
+  pointcloud_sort_rec_t *dst;
+  // PCP_SORT_RADIX entries per worker: its count of every digit,
+  // then the index where its first record of the digit goes
+  size_t                *counts;
+  int                    word;
+  int                    shift;
+} pointcloud_sort_ctx_t;
+
+static void
+pointcloud_sort_fill(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_sort_ctx_t *ctx = (pointcloud_sort_ctx_t *)arg;
+  for (size_t i = begin; i < end; i++)
+  {
+    for (int k = 0; k < 3; k++)
+      ctx->src[i].key[k] = float_sort_key(ctx->pos[3 * i + k]);
+    ctx->src[i].index = (uint32_t)i;
+  }
 }
-int pointcloud_free(pointcloud_t *pc)
+
+static void
+pointcloud_sort_count(void *arg, size_t begin, size_t end, int tid)
 {
-  if (pc == NULL)
-    return 1;
-  if (pc->pos)
+  pointcloud_sort_ctx_t *ctx    = (pointcloud_sort_ctx_t *)arg;
+  size_t                *counts = ctx->counts + tid * PCP_SORT_RADIX;
+  memset(counts, 0, sizeof(size_t) * PCP_SORT_RADIX);
+  for (size_t i = begin; i < end; i++)
+    counts[(ctx->src[i].key[ctx->word] >> ctx->shift) & 0xff]++;
+}
+
+static void
+pointcloud_sort_scatter(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_sort_ctx_t *ctx  = (pointcloud_sort_ctx_t *)arg;
+  size_t                *next = ctx->counts + tid * PCP_SORT_RADIX;
+  for (size_t i = begin; i < end; i++)
   {
-    free(pc->pos);
-    pc->pos = NULL;
+    pointcloud_sort_rec_t r = ctx->src[i];
+    ctx->dst[next[(r.key[ctx->word] >> ctx->shift) & 0xff]++] = r;
   }
-  if (pc->rgb)
+}
+
+// Sorts the points of `pos` by position with a stable LSD radix sort,
+// z first and x last, one byte per pass. Each pass is a parallel
+// count and scatter over the same ranges of records, and is skipped
+// if all keys share its digit. `recs` and `tmp` hold `n` records
+// each; returns the one that ends up sorted.
+static pointcloud_sort_rec_t *
+pointcloud_sort(const float           *pos,
+                size_t                 n,
+                pointcloud_sort_rec_t *recs,
+                pointcloud_sort_rec_t *tmp,
+                size_t                *counts,
+                int                    workers)
+{
+  pointcloud_sort_ctx_t ctx = {pos, recs, tmp, counts};
+  parallel_for(n, workers, pointcloud_sort_fill, &ctx);
+  for (int pass = 0; pass < 12; pass++)
   {
-    free(pc->rgb);
-    pc->rgb = NULL;
+    size_t total = 0;
+    int    skip  = 0;
+    ctx.word     = 2 - pass / 4;
+    ctx.shift    = pass % 4 * 8;
+    parallel_for(n, workers, pointcloud_sort_count, &ctx);
+    for (int d = 0; d < PCP_SORT_RADIX; d++)
+    {
+      size_t start = total;
+      for (int w = 0; w < workers; w++)
+      {
+        size_t *count = &counts[w * PCP_SORT_RADIX + d];
+        size_t  c     = *count;
+        *count        = total;
+        total        += c;
+      }
+      skip |= total - start == n;
+    }
+    if (skip)
+      continue;
+    parallel_for(n, workers, pointcloud_sort_scatter, &ctx);
+    ctx.src = ctx.dst;
+    ctx.dst = ctx.src == recs ? tmp : recs;
   }
-  return 1;
+  return ctx.src;
 }
-int pointcloud_load(pointcloud_t *pc, const char *filename)
+
+static int pointcloud_sort_rec_eq(const pointcloud_sort_rec_t *a,
+                                  const pointcloud_sort_rec_t *b)
 {
-  pointcloud_init(pc, ply_count_vertex(filename));
-  return ply_pointcloud_loader(filename, pc->pos, pc->rgb);
+  return a->key[0] == b->key[0] && a->key[1] == b->key[1] &&
+         a->key[2] == b->key[2];
 }
-int pointcloud_write(pointcloud_t pc,
-                     const char  *filename,
-                     int          binary)
+
+// State of the copy of the points picked by `index` into `out`.
+typedef struct pointcloud_gather_ctx_t
 {
-  FILE *file = fopen(filename, "wb");
-  if (!file)
+  pointcloud_t  pc;
+  const size_t *index;
+  pointcloud_t *out;
+} pointcloud_gather_ctx_t;
+
+static void
+pointcloud_gather(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_gather_ctx_t *ctx = (pointcloud_gather_ctx_t *)arg;
+  pointcloud_t            *out = ctx->out;
+  for (size_t i = begin; i < end; i++)
   {
-    perror("Error opening file");
-    return -1;
+    size_t j = ctx->index[i];
+    memcpy(out->pos + 3 * i, ctx->pc.pos + 3 * j, 3 * sizeof(float));
+    if (ctx->pc.rgb)
+      memcpy(out->rgb + 3 * i, ctx->pc.rgb + 3 * j, 3);
   }
+}
+
+// State of a farthest point sampling. The points are sorted by cell
+// of a grid over the cloud, each with its squared distance to the
+// nearest pick, -1 once picked. The non-empty cells form a max-heap
+// on the largest distance of their points.
+typedef struct pointcloud_fps_t
+{
+  vec3f_t      n;
+  aabb_t       bounds;
+  vec3f_t      inv;
+  int          cells;
+  float       *pos;
+  float       *dist;
+  size_t      *index; // of each sorted point in the cloud
+  size_t      *start; // of the points of each cell, then their end
+  aabb_t      *boxes; // tight bounds of each cell
+  float       *maxd;  // largest distance in each cell
+  size_t      *arg;   // point at that distance
+  int         *heap;
+  int         *slot;  // position of each cell in `heap`
+  int          heap_size;
+  int         *todo;  // cells the current pick may be nearer to
+  size_t       todo_size;
+  const float *pick;
+} pointcloud_fps_t;
 
-  if (binary)
+static float fps_axis_cells(float extent, float step)
+{
+  float n = ceilf(extent / step);
+  return n < 1.0f                     ? 1.0f
+         : n > PCP_FPS_MAX_AXIS_CELLS ? PCP_FPS_MAX_AXIS_CELLS
+                                      : n;
+}
+
+// Splits `b` into about `cells` cells, as cubic as the clamping of
+// every axis to [1, PCP_FPS_MAX_AXIS_CELLS] cells allows.
+static vec3f_t fps_grid_dims(aabb_t b, size_t cells)
+{
+  vec3f_t e = vec3f_sub(b.max, b.min);
+  vec3f_t n = {1, 1, 1};
+  float   s = fmaxf(e.x, fmaxf(e.y, e.z)) / cbrtf((float)cells);
+  for (int it = 0; s > 0 && it < 8; it++)
   {
-    // Binary PLY Header
-    fprintf(file, "ply\n");
-    fprintf(file, "format binary_little_endian 1.0\n");
-    fprintf(file, "element vertex %zu\n", pc.size);
-    fprintf(file, "property float x\n");
-    fprintf(file, "property float y\n");
-    fprintf(file, "property float z\n");
-    fprintf(file, "property uchar red\n");
-    fprintf(file, "property uchar green\n");
-    fprintf(file, "property uchar blue\n");
-    fprintf(file, "end_header\n");
+    n.x  = fps_axis_cells(e.x, s);
+    n.y  = fps_axis_cells(e.y, s);
+    n.z  = fps_axis_cells(e.z, s);
+    s   *= cbrtf(n.x * n.y * n.z / (float)cells);
+  }
+  return n;
+}
 
-    for (size_t i = 0; i < pc.size; ++i)
-    {
-      fwrite(&pc.pos[i * 3], sizeof(float), 3, file);   // x, y, z
-      fwrite(&pc.rgb[i * 3], sizeof(uint8_t), 3, file); // r, g, b
-    }
+// Cell along one axis of the grid holding `v`, clamped to the grid,
+// as grid_tile_id finds it.
+static int fps_axis_cell(float v, float min, float inv, float n)
+{
+  float a = (v - min) * inv * n;
+  if (!(a > 0))
+    return 0;
+  return a < n ? (int)a : (int)n - 1;
+}
+
+// Squared distance from `p` to the box `b`.
+static float fps_box_dist(const float *p, aabb_t b)
+{
+  float lo[3] = {b.min.x, b.min.y, b.min.z};
+  float hi[3] = {b.max.x, b.max.y, b.max.z};
+  float d     = 0;
+  for (int k = 0; k < 3; k++)
+  {
+    float g  = p[k] < lo[k] ? lo[k] - p[k]
+             : p[k] > hi[k] ? p[k] - hi[k]
+                            : 0;
+    d       += g * g;
   }
-  else
+  return d;
+}
+
+// Orders heap positions from the last one.
+static int fps_slot_compare(const void *a, const void *b)
+{
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x < y) - (x > y);
+}
+
+// Moves the cell at `i` of the heap down to where its key, which can
+// only have decreased, fits.
+static void fps_heap_down(pointcloud_fps_t *f, int i)
+{
+  int   c   = f->heap[i];
+  float key = f->maxd[c];
+  while (2 * i + 1 < f->heap_size)
   {
-    // ASCII PLY Header
-    fprintf(file, "ply\n");
-    fprintf(file, "format ascii 1.0\n");
-    fprintf(file, "element vertex %zu\n", pc.size);
-    fprintf(file, "property float x\n");
-    fprintf(file, "property float y\n");
-    fprintf(file, "property float z\n");
-    fprintf(file, "property uchar red\n");
-    fprintf(file, "property uchar green\n");
-    fprintf(file, "property uchar blue\n");
-    fprintf(file, "end_header\n");
+    int m = 2 * i + 1;
+    if (m + 1 < f->heap_size &&
+        f->maxd[f->heap[m + 1]] > f->maxd[f->heap[m]])
+      m++;
+    if (f->maxd[f->heap[m]] <= key)
+      break;
+    f->heap[i]          = f->heap[m];
+    f->slot[f->heap[i]] = i;
+    i                   = m;
+  }
+  f->heap[i] = c;
+  f->slot[c] = i;
+}
 
-    for (size_t i = 0; i < pc.size; ++i)
+// Brings the distances of the points of the cells of `todo` down to
+// the pick, and finds the farthest point of each of them again.
+static void
+pointcloud_fps_update(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_fps_t *f = (pointcloud_fps_t *)arg;
+  const float      *p = f->pick;
+  for (size_t t = begin; t < end; t++)
+  {
+    int    c    = f->todo[t];
+    float  best = -1.0f;
+    size_t at   = f->start[c];
+    for (size_t i = f->start[c]; i < f->start[c + 1]; i++)
     {
-      fprintf(file,
-              "%f %f %f %u %u %u\n",
-              pc.pos[i * 3],
-              pc.pos[i * 3 + 1],
-              pc.pos[i * 3 + 2],
-              pc.rgb[i * 3],
-              pc.rgb[i * 3 + 1],
-              pc.rgb[i * 3 + 2]);
+      float dx = f->pos[3 * i] - p[0];
+      float dy = f->pos[3 * i + 1] - p[1];
+      float dz = f->pos[3 * i + 2] - p[2];
+      float d  = dx * dx + dy * dy + dz * dz;
+      if (d < f->dist[i])
+        f->dist[i] = d;
+      if (f->dist[i] > best)
+      {
+        best = f->dist[i];
+        at   = i;
+      }
     }
+    f->maxd[c] = best;
+    f->arg[c]  = at;
   }
+}
 
-  fclose(file);
-  return 0;
+static void pointcloud_fps_free(pointcloud_fps_t *f)
+{
+  free(f->pos);
+  free(f->dist);
+  free(f->index);
+  free(f->start);
+  free(f->boxes);
+  free(f->maxd);
+  free(f->arg);
+  free(f->heap);
+  free(f->slot);
+  free(f->todo);
 }
 
-int pointcloud_min(pointcloud_t pc, vec3f_t *min)
+// Sorts the points of `pc`, `pc.size` > 0, by cell of the grid, all
+// of them infinitely far from any pick yet.
+static int pointcloud_fps_init(pointcloud_fps_t *f, pointcloud_t pc)
 {
-  if (!pc.pos)
+  int   *ids   = NULL;
+  size_t cells = pc.size / PCP_FPS_CELL_POINTS + 1;
+  pc.has_bounds = 0;
+  pointcloud_bounds(&pc, &f->bounds);
+  f->n     = fps_grid_dims(f->bounds, cells);
+  f->inv   = vec3f_inverse(vec3f_sub(f->bounds.max, f->bounds.min));
+  f->cells = (int)(f->n.x * f->n.y * f->n.z);
+  f->pos   = (float *)malloc(sizeof(float) * 3 * pc.size);
+  f->dist  = (float *)malloc(sizeof(float) * pc.size);
+  f->index = (size_t *)malloc(sizeof(size_t) * pc.size);
+  f->start = (size_t *)calloc((size_t)f->cells + 1, sizeof(size_t));
+  f->boxes = (aabb_t *)malloc(sizeof(aabb_t) * f->cells);
+  f->maxd  = (float *)malloc(sizeof(float) * f->cells);
+  f->arg   = (size_t *)malloc(sizeof(size_t) * f->cells);
+  f->heap  = (int *)malloc(sizeof(int) * f->cells);
+  f->slot  = (int *)malloc(sizeof(int) * f->cells);
+  f->todo  = (int *)malloc(sizeof(int) * f->cells);
+  ids      = (int *)malloc(sizeof(int) * pc.size);
+  if (!f->pos || !f->dist || !f->index || !f->start || !f->boxes ||
+      !f->maxd || !f->arg || !f->heap || !f->slot || !f->todo || !ids)
+  {
+    free(ids);
     return -1;
-  vec3f_t *pos_lst = (vec3f_t *)(pc.pos);
-  *min             = pos_lst[0];
-  for (int i = 0; i < pc.size; i++)
+  }
+
+  // counting sort by cell, `start` holding each cell's end after the
+  // scatter until shifted back
+  pos_tile_ids(pc.pos, pc.size, f->n, f->bounds, ids);
+  for (size_t i = 0; i < pc.size; i++)
+    f->start[ids[i] + 1]++;
+  for (int c = 0; c < f->cells; c++)
+    f->start[c + 1] += f->start[c];
+  for (size_t i = 0; i < pc.size; i++)
+  {
+    size_t j = f->start[ids[i]]++;
+    memcpy(f->pos + 3 * j, pc.pos + 3 * i, 3 * sizeof(float));
+    f->index[j] = i;
+    f->dist[j]  = INFINITY;
+  }
+  memmove(f->start + 1, f->start, sizeof(size_t) * f->cells);
+  f->start[0] = 0;
+  free(ids);
+
+  f->heap_size = 0;
+  for (int c = 0; c < f->cells; c++)
   {
-    if (pos_lst[i].x < min->x)
-      min->x = pos_lst[i].x;
-    if (pos_lst[i].y < min->y)
-      min->y = pos_lst[i].y;
-    if (pos_lst[i].z < min->z)
-      min->z = pos_lst[i].z;
+    if (f->start[c] == f->start[c + 1])
+      continue;
+    pos_bounds(f->pos + 3 * f->start[c],
+               f->start[c + 1] - f->start[c],
+               &f->boxes[c]);
+    f->maxd[c]              = INFINITY;
+    f->arg[c]               = f->start[c];
+    f->slot[c]              = f->heap_size;
+    f->heap[f->heap_size++] = c;
   }
   return 0;
 }
-int pointcloud_max(pointcloud_t pc, vec3f_t *max)
+
+// Cell holding the sorted point `s`.
+static int pointcloud_fps_cell(const pointcloud_fps_t *f, size_t s)
 {
-  if (!pc.pos)
-    return -1;
-  vec3f_t *pos_lst = (vec3f_t *)(pc.pos);
-  *max             = pos_lst[0];
-  for (int i = 0; i < pc.size; i++)
+  // the last cell starting at or before `s`
+  int lo = 0;
+  int hi = f->cells;
+  while (hi - lo > 1)
   {
-    if (pos_lst[i].x > max->x)
-      max->x = pos_lst[i].x;
-    if (pos_lst[i].y > max->y)
-      max->y = pos_lst[i].y;
-    if (pos_lst[i].z > max->z)
-      max->z = pos_lst[i].z;
+    int mid = lo + (hi - lo) / 2;
+    if (f->start[mid] <= s)
+      lo = mid;
+    else
+      hi = mid;
   }
-  return 0;
+  return lo;
 }
 
-int get_tile_id(vec3f_t n, vec3f_t min, vec3f_t max, vec3f_t v)
+// Picks the sorted point `s`, at squared distance `r2` from the
+// previous picks. Only cells within that distance of it can get
+// nearer to the picks, and of them only those whose bounds are
+// nearer than their farthest point.
+static void
+pointcloud_fps_pick(pointcloud_fps_t *f, size_t s, float r2)
 {
-  if (v.x > max.x || v.y > max.y || v.z > max.z || v.x < min.x ||
-      v.y < min.y || v.z < min.z)
-    return -1;
-  vec3f_t ans;
-  // ans = (v - min) / ((max - min) / n);
-  // or ans = (v - min) * (invs(max - min) / n);
-  // or ans = (v - min) * (invs(max - min) * invs(n));
-  // or ans = (v - min) * invs(max - min) * n);
-  ans = vec3f_mul(vec3f_mul(vec3f_sub(v, min),
-                            vec3f_inverse(vec3f_sub(max, min))),
-                  n);
-  ans = (vec3f_t){(int)(ans.x < n.x ? ans.x : n.x - 1),
-                  (int)(ans.y < n.y ? ans.y : n.y - 1),
-                  (int)(ans.z < n.z ? ans.z : n.z - 1)};
+  const float *p      = f->pos + 3 * s;
+  float        r      = sqrtf(r2);
+  float        min[3] = {f->bounds.min.x, f->bounds.min.y,
+                         f->bounds.min.z};
+  float        inv[3] = {f->inv.x, f->inv.y, f->inv.z};
+  float        n[3]   = {f->n.x, f->n.y, f->n.z};
+  int          own    = pointcloud_fps_cell(f, s);
+  int          lo[3];
+  int          hi[3];
+  size_t       work   = f->start[own + 1] - f->start[own];
 
-  return ans.z + ans.y * n.z + ans.x * n.y * n.z;
+  for (int k = 0; k < 3; k++)
+  {
+    lo[k] = fps_axis_cell(p[k] - r, min[k], inv[k], n[k]);
+    hi[k] = fps_axis_cell(p[k] + r, min[k], inv[k], n[k]);
+  }
+  f->pick      = p;
+  f->dist[s]   = -1.0f;
+  f->todo[0]   = own;
+  f->todo_size = 1;
+  for (int x = lo[0]; x <= hi[0]; x++)
+    for (int y = lo[1]; y <= hi[1]; y++)
+      for (int z = lo[2]; z <= hi[2]; z++)
+      {
+        int c = z + y * (int)n[2] + x * (int)n[1] * (int)n[2];
+        if (c == own || !(f->maxd[c] > 0) ||
+            f->start[c] == f->start[c + 1] ||
+            fps_box_dist(p, f->boxes[c]) >= f->maxd[c])
+          continue;
+        f->todo[f->todo_size++]  = c;
+        work                    += f->start[c + 1] - f->start[c];
+      }
+
+  parallel_for(f->todo_size,
+               parallel_workers(work, PCP_FPS_MIN_POINTS),
+               pointcloud_fps_update,
+               f);
+  // the deepest cells first, so that each one moves down into a
+  // valid heap
+  for (size_t t = 0; t < f->todo_size; t++)
+    f->todo[t] = f->slot[f->todo[t]];
+  qsort(f->todo, f->todo_size, sizeof(int), fps_slot_compare);
+  for (size_t t = 0; t < f->todo_size; t++)
+    fps_heap_down(f, f->todo[t]);
 }
 
-// TODO: this function is not safe
-int pointcloud_tile(
-    pointcloud_t pc, int n_x, int n_y, int n_z, pointcloud_t **tiles)
+// Picks `k` <= pc.size points of `pc` into `picks`, in the order they
+// are made: each one is the farthest from those before, the first one
+// is drawn from `seed`. Returns k, or -1 if memory runs out.
+static int pointcloud_fps(pointcloud_t pc,
+                          size_t       k,
+                          uint64_t     seed,
+                          size_t      *picks)
 {
-  vec3f_t  min, max;
-  vec3f_t *pos_lst  = (vec3f_t *)pc.pos;
-  vec3f_t  n        = (vec3f_t){n_x, n_y, n_z};
-  int      size     = n.x * n.y * n.z;
-
-  int     *numVerts = (int *)malloc(sizeof(int) * size);
-  int     *tmp      = (int *)malloc(sizeof(int) * size);
-  *tiles = (pointcloud_t *)malloc(sizeof(pointcloud_t) * size);
-
-  if (!tiles)
+  pointcloud_fps_t f     = {{0}};
+  size_t           first = 0;
+  size_t           drawn = 0;
+  if (k == 0)
+    return 0;
+  if (pointcloud_fps_init(&f, pc) < 0)
   {
-    free(numVerts);
-    free(tmp);
+    pointcloud_fps_free(&f);
     return -1;
   }
 
-  pointcloud_min(pc, &min);
-  pointcloud_max(pc, &max);
-
-  for (int t = 0; t < size; t++)
+  drawn = (size_t)random_below(seed, 0, pc.size);
+  while (f.index[first] != drawn)
+    first++;
+  for (size_t j = 0; j < k; j++)
   {
-    numVerts[t] = 0;
-    tmp[t]      = 0;
+    size_t s  = first;
+    float  r2 = INFINITY;
+    if (j > 0)
+    {
+      s  = f.arg[f.heap[0]];
+      r2 = f.maxd[f.heap[0]];
+    }
+    picks[j] = f.index[s];
+    pointcloud_fps_pick(&f, s, r2);
   }
-  for (int i = 0; i < pc.size; i++)
+  pointcloud_fps_free(&f);
+  return (int)k;
+}
+
+// State of a Poisson disk sampling. The points are sorted by cell of
+// a grid of step `radius` and shuffled within each cell, the ones
+// kept moved to the front of their cell. `table` finds the occupied
+// cells by coordinates.
+typedef struct pointcloud_poisson_t
+{
+  pointcloud_t           pc;
+  aabb_t                 bounds;
+  float                  radius;
+  uint64_t               seed;
+  float                 *grid; // cell coordinates of every point
+  pointcloud_sort_rec_t *recs;
+  pointcloud_sort_rec_t *tmp;
+  size_t                *counts;
+  pointcloud_sort_rec_t *sorted;
+  size_t                 cells;
+  size_t                *start;  // of the points of each cell
+  size_t                *kept;   // points kept in each cell
+  int32_t               *coords; // of each cell
+  size_t                *order;  // cells by color
+  size_t                 colors[PCP_POISSON_COLORS + 1];
+  const size_t          *pass;   // cells of the current color
+  int64_t               *table;
+  size_t                 mask;
+} pointcloud_poisson_t;
+
+static void
+pointcloud_poisson_snap(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_poisson_t *p    = (pointcloud_poisson_t *)arg;
+  float                 m[3] = {p->bounds.min.x, p->bounds.min.y,
+                                p->bounds.min.z};
+  for (size_t i = begin; i < end; i++)
+    for (int k = 0; k < 3; k++)
+      p->grid[3 * i + k] =
+          floorf((p->pc.pos[3 * i + k] - m[k]) / p->radius);
+}
+
+static size_t poisson_hash(const int32_t *c, size_t mask)
+{
+  uint64_t h = (uint64_t)(uint32_t)c[0] * 0x9e3779b97f4a7c15ull ^
+               (uint64_t)(uint32_t)c[1] * 0xc2b2ae3d27d4eb4full ^
+               (uint64_t)(uint32_t)c[2] * 0x165667b19e3779f9ull;
+  return (size_t)(h ^ h >> 32) & mask;
+}
+
+// Cells of the same color, the parities of their coordinates, are
+// never next to each other.
+static int poisson_color(const int32_t *c)
+{
+  return (c[0] & 1) << 2 | (c[1] & 1) << 1 | (c[2] & 1);
+}
+
+// The cell at `c`, or -1 if no point is in it.
+static int64_t pointcloud_poisson_cell(const pointcloud_poisson_t *p,
+                                       const int32_t              *c)
+{
+  size_t h = poisson_hash(c, p->mask);
+  for (; p->table[h] >= 0; h = (h + 1) & p->mask)
   {
-    int t = get_tile_id(n, min, max, pos_lst[i]);
-    numVerts[t]++;
+    const int32_t *o = p->coords + 3 * p->table[h];
+    if (o[0] == c[0] && o[1] == c[1] && o[2] == c[2])
+      return p->table[h];
   }
+  return -1;
+}
 
-  for (int t = 0; t < size; t++)
+static int poisson_rank_compare(const void *a, const void *b)
+{
+  const pointcloud_sort_rec_t *x = (const pointcloud_sort_rec_t *)a;
+  const pointcloud_sort_rec_t *y = (const pointcloud_sort_rec_t *)b;
+  if (x->key[0] != y->key[0])
+    return (x->key[0] > y->key[0]) - (x->key[0] < y->key[0]);
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+// Shuffles the points of each cell by a rank drawn from the seed.
+static void pointcloud_poisson_shuffle(void  *arg,
+                                       size_t begin,
+                                       size_t end,
+                                       int    tid)
+{
+  pointcloud_poisson_t *p = (pointcloud_poisson_t *)arg;
+  for (size_t c = begin; c < end; c++)
   {
-    pointcloud_init(&(*tiles)[t], numVerts[t]);
+    pointcloud_sort_rec_t *r = p->sorted + p->start[c];
+    size_t                 n = p->start[c + 1] - p->start[c];
+    for (size_t i = 0; i < n; i++)
+      r[i].key[0] = (uint32_t)random_u64(p->seed, r[i].index);
+    qsort(r, n, sizeof(pointcloud_sort_rec_t), poisson_rank_compare);
   }
+}
 
-  for (int i = 0; i < pc.size; i++)
+// Keeps each point of the cells [begin, end) of the pass that is at
+// least `radius` from the ones kept in its cell and the 26 around.
+// The cells of a pass share a color: each one only moves its own
+// points, and the ones it reads belong to cells of other colors.
+static void
+pointcloud_poisson_keep(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_poisson_t *p  = (pointcloud_poisson_t *)arg;
+  float                 r2 = p->radius * p->radius;
+  for (size_t o = begin; o < end; o++)
   {
-    int t = get_tile_id(n, min, max, pos_lst[i]);
-    (*tiles)[t].pos[3 * tmp[t]]     = pc.pos[3 * i];
-    (*tiles)[t].pos[3 * tmp[t] + 1] = pc.pos[3 * i + 1];
-    (*tiles)[t].pos[3 * tmp[t] + 2] = pc.pos[3 * i + 2];
-    (*tiles)[t].rgb[3 * tmp[t]]     = pc.rgb[3 * i];
-    (*tiles)[t].rgb[3 * tmp[t] + 1] = pc.rgb[3 * i + 1];
-    (*tiles)[t].rgb[3 * tmp[t] + 2] = pc.rgb[3 * i + 2];
-    tmp[t]++;
+    size_t                 c     = p->pass[o];
+    pointcloud_sort_rec_t *r     = p->sorted + p->start[c];
+    size_t                 n     = p->start[c + 1] - p->start[c];
+    int64_t                near[27];
+    int                    nears = 0;
+    for (int d = 0; d < 27; d++)
+    {
+      int32_t at[3] = {p->coords[3 * c] + d / 9 - 1,
+                       p->coords[3 * c + 1] + d / 3 % 3 - 1,
+                       p->coords[3 * c + 2] + d % 3 - 1};
+      int64_t q     = pointcloud_poisson_cell(p, at);
+      if (q >= 0)
+        near[nears++] = q;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+      const float *x    = p->pc.pos + 3 * (size_t)r[i].index;
+      int          keep = 1;
+      for (int d = 0; keep && d < nears; d++)
+      {
+        int64_t                      q = near[d];
+        const pointcloud_sort_rec_t *s = p->sorted + p->start[q];
+        for (size_t j = 0; keep && j < p->kept[q]; j++)
+        {
+          const float *y  = p->pc.pos + 3 * (size_t)s[j].index;
+          float        dx = x[0] - y[0];
+          float        dy = x[1] - y[1];
+          float        dz = x[2] - y[2];
+          keep            = dx * dx + dy * dy + dz * dz >= r2;
+        }
+      }
+      if (keep)
+      {
+        pointcloud_sort_rec_t t = r[p->kept[c]];
+        r[p->kept[c]++]         = r[i];
+        r[i]                    = t;
+      }
+    }
   }
+}
 
-  free(numVerts);
-  free(tmp);
+static void pointcloud_poisson_free(pointcloud_poisson_t *p)
+{
+  free(p->grid);
+  free(p->recs);
+  free(p->tmp);
+  free(p->counts);
+  free(p->start);
+  free(p->kept);
+  free(p->coords);
+  free(p->order);
+  free(p->table);
+}
 
-  return size;
+// Sorts the points of `p->pc` by cell and shuffles each cell, then
+// indexes the cells by coordinates and by color.
+static int pointcloud_poisson_init(pointcloud_poisson_t *p)
+{
+  size_t  n       = p->pc.size;
+  int     workers = parallel_workers(n, PCP_SORT_MIN_POINTS);
+  size_t  size    = sizeof(pointcloud_sort_rec_t) * (n + 1);
+  vec3f_t e       = {0, 0, 0};
+  float   axis    = 0;
+
+  // the cells are counted from the bounds, which mustn't be stale
+  p->pc.has_bounds = 0;
+  pointcloud_bounds(&p->pc, &p->bounds);
+  e    = vec3f_sub(p->bounds.max, p->bounds.min);
+  axis = fmaxf(e.x, fmaxf(e.y, e.z)) / p->radius;
+  if (!(p->radius > 0) || !(axis < PCP_POISSON_MAX_CELLS))
+    return -1;
+  p->grid   = (float *)malloc(sizeof(float) * 3 * n);
+  p->recs   = (pointcloud_sort_rec_t *)malloc(size);
+  p->tmp    = (pointcloud_sort_rec_t *)malloc(size);
+  p->counts = (size_t *)malloc(
+      sizeof(size_t) * PCP_SORT_RADIX * (size_t)workers);
+  if (!p->grid || !p->recs || !p->tmp || !p->counts)
+    return -1;
+  parallel_for(n, workers, pointcloud_poisson_snap, p);
+  p->sorted = pointcloud_sort(
+      p->grid, n, p->recs, p->tmp, p->counts, workers);
+  for (size_t i = 0; i < n; i++)
+    p->cells += i == 0 || !pointcloud_sort_rec_eq(&p->sorted[i - 1],
+                                                  &p->sorted[i]);
+
+  for (p->mask = 1; p->mask < 2 * p->cells; p->mask <<= 1)
+    ;
+  p->start  = (size_t *)malloc(sizeof(size_t) * (p->cells + 1));
+  p->kept   = (size_t *)calloc(p->cells, sizeof(size_t));
+  p->coords = (int32_t *)malloc(sizeof(int32_t) * 3 * p->cells);
+  p->order  = (size_t *)malloc(sizeof(size_t) * p->cells);
+  p->table  = (int64_t *)malloc(sizeof(int64_t) * p->mask);
+  if (!p->start || !p->kept || !p->coords || !p->order || !p->table)
+    return -1;
+  memset(p->table, 0xff, sizeof(int64_t) * p->mask);
+  p->mask--;
+  for (size_t i = 0, c = 0; i < n; i++)
+  {
+    const float *g = p->grid + 3 * (size_t)p->sorted[i].index;
+    size_t       h = 0;
+    if (i > 0 &&
+        pointcloud_sort_rec_eq(&p->sorted[i - 1], &p->sorted[i]))
+      continue;
+    for (int k = 0; k < 3; k++)
+      p->coords[3 * c + k] = (int32_t)g[k];
+    for (h = poisson_hash(p->coords + 3 * c, p->mask);
+         p->table[h] >= 0;
+         h = (h + 1) & p->mask)
+      ;
+    p->table[h]   = (int64_t)c;
+    p->start[c++] = i;
+  }
+  p->start[p->cells] = n;
+  parallel_for(p->cells,
+               parallel_workers(p->cells, PCP_POISSON_MIN_CELLS),
+               pointcloud_poisson_shuffle,
+               p);
+
+  // counting sort of the cells by color
+  for (size_t c = 0; c < p->cells; c++)
+    p->colors[poisson_color(p->coords + 3 * c) + 1]++;
+  for (int col = 0; col < PCP_POISSON_COLORS; col++)
+    p->colors[col + 1] += p->colors[col];
+  for (size_t c = 0; c < p->cells; c++)
+    p->order[p->colors[poisson_color(p->coords + 3 * c)]++] = c;
+  memmove(p->colors + 1,
+          p->colors,
+          sizeof(size_t) * PCP_POISSON_COLORS);
+  p->colors[0] = 0;
+  return 0;
 }
 
-int pointcloud_merge(pointcloud_t *pcs,
-                     size_t        pc_count,
-                     pointcloud_t *out)
+// Keeps points of `pc`, `pc.size` > 0, no two of them nearer than
+// `radius`, into `picks` in increasing order. The points are tried in
+// a random order drawn from `seed` within each cell of a grid of step
+// `radius`, and the cells one color at a time, so the result does not
+// depend on the number of threads. Returns the number of points kept,
+// or -1 if `radius` is too small for the grid or memory runs out.
+static int pointcloud_poisson(pointcloud_t pc,
+                              float        radius,
+                              uint64_t     seed,
+                              size_t      *picks)
 {
-  size_t total_size = 0;
-  for (int i = 0; i < pc_count; i++)
-    total_size += pcs[i].size;
-  if (pointcloud_init(out, total_size) < 0)
+  pointcloud_poisson_t p     = {pc, {{0}}, radius, seed};
+  uint8_t             *flags = NULL;
+  size_t               count = 0;
+
+  if (pointcloud_poisson_init(&p) < 0 ||
+      !(flags = (uint8_t *)calloc(pc.size, 1)))
   {
-    return -1; // Memory allocation failed
+    pointcloud_poisson_free(&p);
+    return -1;
+  }
+  for (int col = 0; col < PCP_POISSON_COLORS; col++)
+  {
+    size_t cells = p.colors[col + 1] - p.colors[col];
+    p.pass       = p.order + p.colors[col];
+    parallel_for(cells,
+                 parallel_workers(cells, PCP_POISSON_MIN_CELLS),
+                 pointcloud_poisson_keep,
+                 &p);
   }
 
-  int curr = 0;
-  for (int i = 0; i < pc_count; i++)
+  // the kept points, back in the order of the cloud
+  for (size_t c = 0; c < p.cells; c++)
+    for (size_t j = 0; j < p.kept[c]; j++)
+      flags[p.sorted[p.start[c] + j].index] = 1;
+  for (size_t i = 0; i < pc.size; i++)
+    if (flags[i])
+      picks[count++] = i;
+  free(flags);
+  pointcloud_poisson_free(&p);
+  return (int)count;
+}
+
+// Poisson disk sample of about `k` points of `pc`. The number of
+// points a spacing keeps on a surface goes as its inverse square, so
+// each try scales the spacing by the square root of how far its count
+// was off, from a first guess that the cloud is a surface as large as
+// its bounds.
+static int pointcloud_poisson_fit(pointcloud_t pc,
+                                  size_t       k,
+                                  uint64_t     seed,
+                                  size_t      *picks)
+{
+  aabb_t  b      = {{0, 0, 0}, {0, 0, 0}};
+  vec3f_t e      = {0, 0, 0};
+  float   r      = 0;
+  float   min_r  = 0;
+  float   best_r = 0;
+  size_t  best   = 0;
+  int     got    = 0;
+
+  if (k == 0 || pointcloud_bounds(&pc, &b) < 0)
+    return 0;
+  e     = vec3f_sub(b.max, b.min);
+  min_r = 2.0f * fmaxf(e.x, fmaxf(e.y, e.z)) / PCP_POISSON_MAX_CELLS;
+  r     = sqrtf((e.x * e.y + e.y * e.z + e.z * e.x) / (float)k);
+  for (int step = 0; step < PCP_POISSON_FIT_STEPS; step++)
   {
-    memcpy((char *)(out->pos + curr * 3),
-           (char *)pcs[i].pos,
-           pcs[i].size * 3 * sizeof(float));
-    memcpy((char *)(out->rgb + curr * 3),
-           (char *)pcs[i].rgb,
-           pcs[i].size * 3 * sizeof(uint8_t));
-    curr += pcs[i].size;
+    size_t off = 0;
+    r          = r > min_r ? r : min_r;
+    if (!(r > 0))
+      r = 1.0f;
+    if ((got = pointcloud_poisson(pc, r, seed, picks)) < 0)
+      return -1;
+    off = (size_t)got > k ? (size_t)got - k : k - (size_t)got;
+    if (step == 0 || off < best)
+    {
+      best   = off;
+      best_r = r;
+    }
+    if (off <= k / PCP_POISSON_FIT_SLACK)
+      return got;
+    r *= sqrtf((float)got / (float)k);
   }
-  return 1;
+  return pointcloud_poisson(pc, best_r, seed, picks);
+}
+
+// Copies the `count` points of `pc` picked by `index` into `out`.
+static void pointcloud_gather_picks(pointcloud_t  pc,
+                                    const size_t *index,
+                                    size_t        count,
+                                    pointcloud_t *out)
+{
+  pointcloud_gather_ctx_t ctx = {pc, index, out};
+  pointcloud_init_props(
+      out, count, pc.rgb ? PCP_PROP_ALL : PCP_PROP_POS);
+  parallel_for(count,
+               parallel_workers(count, PCP_MERGE_MIN_POINTS),
+               pointcloud_gather,
+               &ctx);
 }
 
 int pointcloud_sample(pointcloud_t  pc,
                       float         ratio,
                       unsigned char strategy,
+                      uint64_t      seed,
                       pointcloud_t *out)
 {
-  size_t num_points = (size_t)(pc.size * ratio);
-
-  pointcloud_init(out, num_points);
+  size_t  num_points = (size_t)(pc.size * ratio);
+  size_t  capacity   = num_points;
+  size_t *index      = NULL;
+  int     picked     = -1;
 
+  // a Poisson disk sample may keep more points than asked for
+  if (strategy == PCP_SAMPLE_RULE_POISSON)
+    capacity = pc.size;
+  index = (size_t *)malloc(sizeof(size_t) * (capacity + 1));
+  if (!index)
+    return -1;
   switch (strategy)
   {
   case PCP_SAMPLE_RULE_UNIFORM:
-  {
-    int *index_arr = (int *)malloc(sizeof(int) * pc.size);
-    int *sample    = (int *)malloc(num_points * sizeof(int));
-    // Seed the random number generator
-    srand((unsigned int)time(NULL));
-    for (int i = 0; i < pc.size; i++)
-      index_arr[i] = i;
-    sample_union(index_arr, pc.size, sample, num_points);
-    for (int i = 0; i < num_points; i++)
-    {
-      for (int j = 0; j < 3; j++)
-      {
-        out->pos[i * 3 + j] = pc.pos[sample[i] * 3 + j];
-        out->rgb[i * 3 + j] = pc.rgb[sample[i] * 3 + j];
-      }
-    }
-    free(index_arr);
-    free(sample);
+    // the picks are in increasing order, so are the points copied
+    picked = sample_indices(seed, pc.size, num_points, index);
+    break;
+  case PCP_SAMPLE_RULE_FPS:
+    // in the order of the picks, so that any prefix is spread out
+    if (num_points <= pc.size)
+      picked = pointcloud_fps(pc, num_points, seed, index);
+    break;
+  case PCP_SAMPLE_RULE_POISSON:
+    // in increasing order too
+    picked = pointcloud_poisson_fit(pc, num_points, seed, index);
     break;
-  }
   default:
     break;
   }
+  if (picked < 0)
+  {
+    free(index);
+    return -1;
+  }
 
-  return 1;
+  pointcloud_gather_picks(pc, index, (size_t)picked, out);
+  free(index);
+  return out->size;
 }
 
-static void pointcloud_element_merge(pointcloud_t pc,
-                                     int          left,
-                                     int          mid,
-                                     int          right)
+int pointcloud_sample_poisson(pointcloud_t  pc,
+                              float         radius,
+                              uint64_t      seed,
+                              pointcloud_t *out)
 {
-  vec3f_t  *arr_pos = (vec3f_t *)pc.pos;
-  vec3uc_t *arr_col = (vec3uc_t *)pc.rgb;
-
-  int       n1      = mid - left + 1;
-  int       n2      = right - mid;
-
-  vec3f_t  *L_pos   = (vec3f_t *)malloc(n1 * sizeof(vec3f_t));
-  vec3f_t  *R_pos   = (vec3f_t *)malloc(n2 * sizeof(vec3f_t));
+  int     picked = 0;
+  size_t *index  = (size_t *)malloc(sizeof(size_t) * (pc.size + 1));
+  if (!index)
+    return -1;
+  if (pc.size > 0)
+    picked = pointcloud_poisson(pc, radius, seed, index);
+  if (picked < 0)
+  {
+    free(index);
+    return -1;
+  }
+  pointcloud_gather_picks(pc, index, (size_t)picked, out);
+  free(index);
+  return out->size;
+}
 
-  vec3uc_t *L_col   = (vec3uc_t *)malloc(n1 * sizeof(vec3uc_t));
-  vec3uc_t *R_col   = (vec3uc_t *)malloc(n2 * sizeof(vec3uc_t));
+int pointcloud_remove_dupplicates(pointcloud_t  pc,
+                                  unsigned char policy,
+                                  pointcloud_t *out)
+{
+  int    workers = parallel_workers(pc.size, PCP_SORT_MIN_POINTS);
+  size_t size    = sizeof(pointcloud_sort_rec_t) * (pc.size + 1);
+  size_t unique  = 0;
+  pointcloud_sort_rec_t *recs   = NULL;
+  pointcloud_sort_rec_t *tmp    = NULL;
+  pointcloud_sort_rec_t *sorted = NULL;
+  size_t                *counts = NULL;
 
-  for (int i = 0; i < n1; i++)
+  if (policy != PCP_DEDUP_KEEP_FIRST && policy != PCP_DEDUP_AVERAGE)
+    return -1;
+  recs   = (pointcloud_sort_rec_t *)malloc(size);
+  tmp    = (pointcloud_sort_rec_t *)malloc(size);
+  counts = (size_t *)malloc(
+      sizeof(size_t) * PCP_SORT_RADIX * (size_t)workers);
+  if (!recs || !tmp || !counts)
   {
-    *(L_pos + i) = arr_pos[left + i];
-    *(L_col + i) = arr_col[left + i];
+    free(recs);
+    free(tmp);
+    free(counts);
+    return -1;
   }
-  for (int i = 0; i < n2; i++)
+
+  // sort the points, then keep one of each run of equal positions
+  sorted =
+      pointcloud_sort(pc.pos, pc.size, recs, tmp, counts, workers);
+  for (size_t i = 0; i < pc.size; i++)
+    unique += i == 0 || !pointcloud_sort_rec_eq(&sorted[i - 1],
+                                                &sorted[i]);
+  pointcloud_init_props(
+      out, unique, pc.rgb ? PCP_PROP_ALL : PCP_PROP_POS);
+  if (unique > 0 && (!out->pos || (pc.rgb && !out->rgb)))
   {
-    *(R_pos + i) = arr_pos[mid + 1 + i];
-    *(R_col + i) = arr_col[mid + 1 + i];
+    pointcloud_free(out);
+    free(recs);
+    free(tmp);
+    free(counts);
+    return -1;
   }
-  int i = 0, j = 0, k = left;
-  while (i < n1 && j < n2)
+
+  for (size_t i = 0, u = 0; i < pc.size; u++)
   {
-    if (vec3f_leq(*(L_pos + i), *(R_pos + j)))
-    {
-      arr_pos[k]   = *(L_pos + i);
-      arr_col[k++] = *(L_col + i++);
-    }
-    else
+    // the sort is stable, so a run starts with the first occurrence
+    size_t   first  = sorted[i].index;
+    size_t   end    = i + 1;
+    uint32_t sum[3] = {0, 0, 0};
+    while (end < pc.size &&
+           pointcloud_sort_rec_eq(&sorted[i], &sorted[end]))
+      end++;
+    memcpy(out->pos + 3 * u, pc.pos + 3 * first, 3 * sizeof(float));
+    if (pc.rgb && policy == PCP_DEDUP_AVERAGE)
     {
-      arr_pos[k]   = *(R_pos + j);
-      arr_col[k++] = *(R_col + j++);
+      for (size_t j = i; j < end; j++)
+        for (int k = 0; k < 3; k++)
+          sum[k] += pc.rgb[3 * sorted[j].index + k];
+      for (int k = 0; k < 3; k++)
+        out->rgb[3 * u + k] =
+            (uint8_t)((sum[k] + (end - i) / 2) / (end - i));
     }
-  }
-  while (i < n1)
-  {
-    arr_pos[k]   = *(L_pos + i);
-    arr_col[k++] = *(L_col + i++);
-  }
-  while (j < n2)
-  {
-    arr_pos[k]   = *(R_pos + j);
-    arr_col[k++] = *(R_col + j++);
+    else if (pc.rgb)
+      memcpy(out->rgb + 3 * u, pc.rgb + 3 * first, 3);
+    i = end;
   }
 
-  free(L_pos);
-  free(R_pos);
-  free(L_col);
-  free(R_col);
+  free(recs);
+  free(tmp);
+  free(counts);
+  return out->size;
 }
-static void
-pointcloud_element_merge_sort(pointcloud_t pc, int left, int right)
+
+// State of a voxelization. `firsts` holds, for each worker, its
+// count of voxels, then the index of its first one in `out`.
+typedef struct pointcloud_voxel_ctx_t
 {
-  if (left >= right)
-    return;
-  int mid = left + (right - left) / 2;
+  pointcloud_t                 pc;
+  float                        size;
+  unsigned char                policy;
+  float                       *grid;
+  const pointcloud_sort_rec_t *sorted;
+  size_t                      *firsts;
+  pointcloud_t                *out;
+} pointcloud_voxel_ctx_t;
 
-  pointcloud_element_merge_sort(pc, left, mid);
-  pointcloud_element_merge_sort(pc, mid + 1, right);
+static void
+pointcloud_voxel_snap(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_voxel_ctx_t *ctx = (pointcloud_voxel_ctx_t *)arg;
+  for (size_t i = 3 * begin; i < 3 * end; i++)
+    ctx->grid[i] = quantize(ctx->pc.pos[i], ctx->size);
+}
 
-  pointcloud_element_merge(pc, left, mid, right);
+// Whether record `i` starts a voxel, i.e. a run of equal keys.
+static int
+pointcloud_voxel_starts(const pointcloud_voxel_ctx_t *ctx, size_t i)
+{
+  const pointcloud_sort_rec_t *s = ctx->sorted;
+  return i == 0 || !pointcloud_sort_rec_eq(&s[i - 1], &s[i]);
 }
 
-int pointcloud_remove_dupplicates(pointcloud_t pc, pointcloud_t *out)
+static void
+pointcloud_voxel_count(void *arg, size_t begin, size_t end, int tid)
 {
-  // use mergesort to sort points, then remove consecutives,
-  // O(Nlog(N))
-  pointcloud_element_merge_sort(pc, 0, pc.size - 1);
+  pointcloud_voxel_ctx_t *ctx = (pointcloud_voxel_ctx_t *)arg;
+  size_t                  n   = 0;
+  for (size_t i = begin; i < end; i++)
+    n += pointcloud_voxel_starts(ctx, i);
+  ctx->firsts[tid] = n;
+}
 
-  // count unique points to get output size
-  size_t count_unique = 1;
-  for (int i = 1; i < pc.size; i++)
+// Median of channel `k` of the colors of the `n` points of `recs`,
+// the lower one if `n` is even.
+static uint8_t
+pointcloud_voxel_median(const uint8_t               *rgb,
+                        const pointcloud_sort_rec_t *recs,
+                        size_t                       n,
+                        int                          k)
+{
+  if (n <= PCP_VOXEL_SMALL_RUN)
   {
-    vec3f_t pre  = ((vec3f_t *)pc.pos)[i - 1];
-    vec3f_t curr = ((vec3f_t *)pc.pos)[i];
-    if (!vec3f_eq(pre, curr))
+    uint8_t v[PCP_VOXEL_SMALL_RUN];
+    for (size_t i = 0; i < n; i++)
     {
-      count_unique++;
+      uint8_t c = rgb[3 * recs[i].index + k];
+      size_t  j = i;
+      for (; j > 0 && v[j - 1] > c; j--)
+        v[j] = v[j - 1];
+      v[j] = c;
     }
+    return v[(n - 1) / 2];
   }
-  pointcloud_init(out, count_unique);
-
-  // puts the unique points into the output, O(N)
-  vec3f_t  *uni_pos = (vec3f_t *)(out->pos);
-  vec3uc_t *uni_col = (vec3uc_t *)(out->rgb);
-  vec3f_t  *pos     = (vec3f_t *)(pc.pos);
-  vec3uc_t *col     = (vec3uc_t *)(pc.rgb);
+  size_t hist[256] = {0};
+  size_t seen      = 0;
+  int    c         = 0;
+  for (size_t i = 0; i < n; i++)
+    hist[rgb[3 * recs[i].index + k]]++;
+  while ((seen += hist[c]) <= (n - 1) / 2)
+    c++;
+  return (uint8_t)c;
+}
 
-  int       index   = 0;
-  for (int i = 1; i < pc.size; i++)
+// Merges the voxels starting in [begin, end) into points of `out`,
+// from index firsts[tid] on. A voxel may run past `end`.
+static void
+pointcloud_voxel_merge(void *arg, size_t begin, size_t end, int tid)
+{
+  pointcloud_voxel_ctx_t      *ctx    = (pointcloud_voxel_ctx_t *)arg;
+  const pointcloud_sort_rec_t *sorted = ctx->sorted;
+  const uint8_t               *rgb    = ctx->pc.rgb;
+  pointcloud_t                *out    = ctx->out;
+  size_t                       u      = ctx->firsts[tid];
+  size_t                       i      = begin;
+  while (i < end && !pointcloud_voxel_starts(ctx, i))
+    i++;
+  while (i < end)
   {
-    if (!vec3f_eq(pos[i], pos[i - 1]))
+    size_t last = i + 1;
+    while (last < ctx->pc.size &&
+           pointcloud_sort_rec_eq(&sorted[i], &sorted[last]))
+      last++;
+    memcpy(out->pos + 3 * u,
+           ctx->grid + 3 * sorted[i].index,
+           3 * sizeof(float));
+    for (int k = 0; rgb && k < 3; k++)
     {
-      uni_pos[index]   = pos[i];
-      uni_col[index++] = col[i]; // Start the color for the new point
+      size_t sum = 0;
+      if (ctx->policy == PCP_VOXEL_MEDIAN)
+      {
+        out->rgb[3 * u + k] =
+            pointcloud_voxel_median(rgb, sorted + i, last - i, k);
+        continue;
+      }
+      for (size_t j = i; j < last; j++)
+        sum += rgb[3 * sorted[j].index + k];
+      out->rgb[3 * u + k] =
+          (uint8_t)((sum + (last - i) / 2) / (last - i));
     }
+    u++;
+    i = last;
   }
-
-  return out->size;
 }
 
 int pointcloud_voxel(pointcloud_t  pc,
                      float         voxel_size,
+                     unsigned char policy,
                      pointcloud_t *out)
 {
-  // quantize the points to the voxel grid
-  // then remove the duplicates, should it tho ?
-
-  pointcloud_init(out, pc.size);
-
-  memcpy(out->pos, pc.pos, pc.size * sizeof(float) * 3);
-  memcpy(out->rgb, pc.rgb, pc.size * sizeof(uint8_t) * 3);
+  int    workers = parallel_workers(pc.size, PCP_SORT_MIN_POINTS);
+  size_t size    = sizeof(pointcloud_sort_rec_t) * (pc.size + 1);
+  size_t voxels  = 0;
+  pointcloud_sort_rec_t *recs   = NULL;
+  pointcloud_sort_rec_t *tmp    = NULL;
+  size_t                *counts = NULL;
+  pointcloud_voxel_ctx_t ctx    = {pc, voxel_size, policy};
 
-  vec3f_t *pos = (vec3f_t *)out->pos;
-  for (int i = 0; i < out->size; i++)
-    pos[i] = vec3f_quantize(pos[i], voxel_size);
+  if (!(voxel_size > 0.0f))
+    return -1;
+  recs   = (pointcloud_sort_rec_t *)malloc(size);
+  tmp    = (pointcloud_sort_rec_t *)malloc(size);
+  counts = (size_t *)malloc(
+      sizeof(size_t) * PCP_SORT_RADIX * (size_t)workers);
+  ctx.grid   = (float *)malloc(sizeof(float) * 3 * (pc.size + 1));
+  ctx.firsts = (size_t *)calloc((size_t)workers, sizeof(size_t));
+  ctx.out    = out;
+  if (recs && tmp && counts && ctx.grid && ctx.firsts)
+  {
+    // snap the points to the grid and sort them by voxel, then merge
+    // each run of points in the same voxel, every worker starting
+    // where the voxels of the previous ones end
+    parallel_for(pc.size, workers, pointcloud_voxel_snap, &ctx);
+    ctx.sorted = pointcloud_sort(
+        ctx.grid, pc.size, recs, tmp, counts, workers);
+    parallel_for(pc.size, workers, pointcloud_voxel_count, &ctx);
+    for (int w = 0; w < workers; w++)
+    {
+      size_t n       = ctx.firsts[w];
+      ctx.firsts[w]  = voxels;
+      voxels        += n;
+    }
+    pointcloud_init_props(
+        out, voxels, pc.rgb ? PCP_PROP_ALL : PCP_PROP_POS);
+    parallel_for(pc.size, workers, pointcloud_voxel_merge, &ctx);
+  }
 
-  // pointcloud_remove_dupplicates(pc, out);
+  free(recs);
+  free(tmp);
+  free(counts);
+  free(ctx.grid);
+  free(ctx.firsts);
+  return ctx.sorted ? (int)out->size : -1;
 }
 
 int pointcloud_count_pixel_per_tile(pointcloud_t pc,
@@ -413,16 +2982,26 @@ int pointcloud_count_pixel_per_tile(pointcloud_t pc,
   for (int i = 0; i < nx * ny * nz; i++)
     pixel_count[i] = 0;
 
-  vec3f_t  *points    = (vec3f_t *)pc.pos;
-  vec3f_t   ndc       = {0, 0, 0};
-  int       screen_w  = 0;
-  int       screen_h  = 0;
-  int       tile_id   = 0;
-  float   **minZvalue = NULL;
-  int16_t **curr_tile = NULL;
-  vec3f_t   min, max;
-  pointcloud_min(pc, &min);
-  pointcloud_max(pc, &max);
+  pointcloud_soa_t blk       = {NULL, NULL, NULL, NULL, 0};
+  pointcloud_soa_t ndc       = {NULL, NULL, NULL, NULL, 0};
+  int             *tile_ids  = NULL;
+  int              screen_w  = 0;
+  int              screen_h  = 0;
+  float          **minZvalue = NULL;
+  int16_t        **curr_tile = NULL;
+  aabb_t           bounds    = {{0, 0, 0}, {0, 0, 0}};
+  // points outside stale bounds would fall outside the tiles
+  pc.has_bounds = 0;
+  pointcloud_bounds(&pc, &bounds);
+  tile_ids = (int *)malloc(sizeof(int) * PCP_SOA_BLOCK_POINTS);
+  if (!tile_ids || pointcloud_soa_init(&blk, PCP_SOA_BLOCK_POINTS) ||
+      pointcloud_soa_init(&ndc, PCP_SOA_BLOCK_POINTS))
+  {
+    free(tile_ids);
+    pointcloud_soa_free(&blk);
+    pointcloud_soa_free(&ndc);
+    return -1;
+  }
 
   minZvalue = (float **)malloc(sizeof(float *) * height);
   for (int i = 0; i < height; i++)
@@ -441,35 +3020,55 @@ int pointcloud_count_pixel_per_tile(pointcloud_t pc,
       curr_tile[i][j] = -1;
   }
 
-  for (int i = 0; i < pc.size; i++)
+  // The points are copied a block at a time into SoA layout, where
+  // the tile ids and the projection are vectorized; only the depth
+  // test runs point by point.
+  for (size_t b = 0; b < pc.size; b += PCP_SOA_BLOCK_POINTS)
   {
-    tile_id =
-        (int)get_tile_id((vec3f_t){nx, ny, nz}, min, max, points[i]);
-
-    vec3f_t ndc = vec3f_mvp_mul(points[i], mvp);
-    // check only if ndc is in side view-frustum
-    if (ndc.x >= -1 && ndc.x <= 1 && ndc.y >= -1 && ndc.y <= 1 &&
-        ndc.z >= 0 && ndc.z <= 1)
+    size_t n = pc.size - b;
+    if (n > PCP_SOA_BLOCK_POINTS)
+      n = PCP_SOA_BLOCK_POINTS;
+    for (size_t i = 0; i < n; i++)
     {
-      // screen_w = (int)((ndc.x + 1.0) * 0.5 * width);
-      // screen_h = (int)((1.0 - ndc.y) * 0.5 * height);
+      blk.x[i] = pc.pos[3 * (b + i)];
+      blk.y[i] = pc.pos[3 * (b + i) + 1];
+      blk.z[i] = pc.pos[3 * (b + i) + 2];
+    }
+    blk.size = n;
+    soa_pad(blk.x, n);
+    soa_pad(blk.y, n);
+    soa_pad(blk.z, n);
+    pointcloud_soa_tile_ids(
+        blk, (vec3f_t){nx, ny, nz}, bounds, tile_ids);
+    pointcloud_soa_project(blk, mvp, &ndc);
 
-      screen_w = fminf(
-          width - 1, fmaxf(0, (int)((ndc.x + 1.0f) * 0.5f * width)));
-      screen_h =
-          fminf(height - 1,
-                fmaxf(0, (int)((1.0f - ndc.y) * 0.5f * height)));
+    for (size_t i = 0; i < n; i++)
+    {
+      float x = ndc.x[i];
+      float y = ndc.y[i];
+      float z = ndc.z[i];
+      // check only if ndc is in side view-frustum
+      if (!(x >= -1 && x <= 1 && y >= -1 && y <= 1 && z >= 0 &&
+            z <= 1))
+        continue;
+      screen_w = fminf(width - 1,
+                       fmaxf(0, (int)((x + 1.0f) * 0.5f * width)));
+      screen_h = fminf(height - 1,
+                       fmaxf(0, (int)((1.0f - y) * 0.5f * height)));
 
       // If current point is nearer to the camera, then:
       // - minZvalue is updated
       // curr_tile is also updated
-      if (ndc.z < minZvalue[screen_h][screen_w])
+      if (z < minZvalue[screen_h][screen_w])
       {
-        minZvalue[screen_h][screen_w] = ndc.z;
-        curr_tile[screen_h][screen_w] = tile_id;
+        minZvalue[screen_h][screen_w] = z;
+        curr_tile[screen_h][screen_w] = tile_ids[i];
       }
     }
   }
+  free(tile_ids);
+  pointcloud_soa_free(&blk);
+  pointcloud_soa_free(&ndc);
   // After we have known each pixel hold the point of which tile, we
   // count.
   for (int i = 0; i < height; i++)
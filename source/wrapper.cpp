@@ -1,16 +1,135 @@
 #include "pcprep/wrapper.h"
 #include "miniply/miniply.h"
 #include <cstring>
+#include <fcntl.h>
 #include <stdint.h>
-extern bool p_vert_col_ply_loader(const char    *filename,
-                                  float         *pos,
-                                  unsigned char *rgb)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct ply_reader_t
+{
+  miniply::PLYReader reader;
+
+  ply_reader_t(const char *filename) : reader(filename) {}
+};
+
+// Loads the vertex element of a binary little-endian PLY straight
+// from a read-only mapping of the file, de-interleaving x, y, z and
+// red, green, blue into `pos` and `rgb` in a single pass. This skips
+// the read buffer and the full-element copy miniply makes in
+// `load_element`. Returns false, without touching `pos` or `rgb`,
+// when the layout isn't one we handle here so that the caller can
+// fall back to the generic loader.
+static bool p_vert_col_mmap_loader(miniply::PLYReader &reader,
+                                   float              *pos,
+                                   unsigned char      *rgb)
+{
+  if (reader.file_type() != miniply::PLYFileType::Binary ||
+      !reader.element_is(miniply::kPLYVertexElement))
+  {
+    return false;
+  }
+
+  const miniply::PLYElement *elem = reader.element();
+  uint32_t                   posIdxs[3];
+  uint32_t                   colIdxs[3];
+  bool hasColor = rgb != nullptr && reader.find_color(colIdxs);
+  if (!elem->fixedSize || !reader.find_pos(posIdxs))
+  {
+    return false;
+  }
+  uint32_t posOffs[3];
+  uint32_t colOffs[3] = {0, 0, 0};
+  for (int i = 0; i < 3; i++)
+  {
+    const miniply::PLYProperty &p = elem->properties[posIdxs[i]];
+    if (p.type != miniply::PLYPropertyType::Float)
+    {
+      return false;
+    }
+    posOffs[i] = p.offset;
+    if (hasColor)
+    {
+      const miniply::PLYProperty &c = elem->properties[colIdxs[i]];
+      if (c.type != miniply::PLYPropertyType::UChar)
+      {
+        return false;
+      }
+      colOffs[i] = c.offset;
+    }
+  }
+
+  int64_t     dataStart = reader.file_offset();
+  size_t      stride    = elem->rowStride;
+  size_t      count     = elem->count;
+  size_t      dataSize  = stride * count;
+
+  int         fd        = fileno(reader.file_handle());
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || dataStart < 0 ||
+      static_cast<uint64_t>(st.st_size) <
+          static_cast<uint64_t>(dataStart) + dataSize)
+  {
+    return false;
+  }
+  size_t mapSize = static_cast<size_t>(st.st_size);
+  void  *map =
+      mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+  {
+    return false;
+  }
+  madvise(map, mapSize, MADV_SEQUENTIAL);
+
+  const uint8_t *row = static_cast<const uint8_t *>(map) + dataStart;
+  bool           packed =
+      posOffs[1] == posOffs[0] + 4 && posOffs[2] == posOffs[0] + 8 &&
+      colOffs[1] == colOffs[0] + 1 && colOffs[2] == colOffs[0] + 2;
+  if (packed)
+  {
+    // The common case (x y z red green blue, possibly with other
+    // properties around them): two fixed-size copies per row.
+    for (size_t i = 0; i < count; i++, row += stride)
+    {
+      std::memcpy(pos + i * 3, row + posOffs[0], 3 * sizeof(float));
+      if (hasColor)
+      {
+        std::memcpy(rgb + i * 3, row + colOffs[0], 3);
+      }
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < count; i++, row += stride)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        std::memcpy(pos + i * 3 + j, row + posOffs[j], sizeof(float));
+        if (hasColor)
+        {
+          rgb[i * 3 + j] = row[colOffs[j]];
+        }
+      }
+    }
+  }
+
+  munmap(map, mapSize);
+  return true;
+}
+
+static bool p_vert_col_ply_loader(miniply::PLYReader &reader,
+                                  float              *pos,
+                                  unsigned char      *rgb)
 {
-  miniply::PLYReader reader(filename);
   if (!reader.valid())
   {
     return 0;
   }
+  if (p_vert_col_mmap_loader(reader, pos, rgb))
+  {
+    return 1;
+  }
 
   uint32_t propIdxs[3];
   bool     gotVerts = false;
@@ -26,7 +145,7 @@ extern bool p_vert_col_ply_loader(const char    *filename,
 
       reader.extract_properties(
           propIdxs, 3, miniply::PLYPropertyType::Float, pos);
-      if (reader.find_color(propIdxs))
+      if (rgb != nullptr && reader.find_color(propIdxs))
       {
         reader.extract_properties(
             propIdxs, 3, miniply::PLYPropertyType::UChar, rgb);
@@ -38,11 +157,10 @@ extern bool p_vert_col_ply_loader(const char    *filename,
   return 1;
 }
 
-extern bool p_pos_indices_ply_loader(const char *filename,
-                                     float      *pos,
-                                     int        *indices)
+static bool p_pos_indices_ply_loader(miniply::PLYReader &reader,
+                                     float              *pos,
+                                     int                *indices)
 {
-  miniply::PLYReader reader(filename);
   if (!reader.valid())
   {
     return 0;
@@ -90,43 +208,138 @@ extern bool p_pos_indices_ply_loader(const char *filename,
   return 1;
 }
 
+// Reads the next `maxPoints` vertices, or as many as are left, of
+// the vertex element without loading the rest of it. Elements before
+// the vertex element are skipped on the first call. Returns the
+// number of vertices read, 0 once they are exhausted, or -1 if the
+// file has no usable vertex element or is truncated.
+static int p_vert_col_ply_rows(miniply::PLYReader &reader,
+                               size_t              maxPoints,
+                               float              *pos,
+                               unsigned char      *rgb)
+{
+  while (reader.has_element() &&
+         !reader.element_is(miniply::kPLYVertexElement))
+  {
+    reader.next_element();
+  }
+  if (!reader.has_element())
+  {
+    return reader.valid() ? 0 : -1;
+  }
+
+  uint32_t propIdxs[3];
+  if (!reader.element()->fixedSize || !reader.find_pos(propIdxs))
+  {
+    return -1;
+  }
+  if (maxPoints > INT32_MAX)
+  {
+    maxPoints = INT32_MAX;
+  }
+  uint32_t rows = reader.load_rows(static_cast<uint32_t>(maxPoints));
+  if (!reader.valid())
+  {
+    return -1;
+  }
+  if (rows == 0)
+  {
+    return 0;
+  }
+  reader.extract_properties(
+      propIdxs, 3, miniply::PLYPropertyType::Float, pos);
+  if (rgb != nullptr && reader.find_color(propIdxs))
+  {
+    reader.extract_properties(
+        propIdxs, 3, miniply::PLYPropertyType::UChar, rgb);
+  }
+  return static_cast<int>(rows);
+}
+
+static int p_count_element(miniply::PLYReader &reader,
+                           const char         *name)
+{
+  if (!reader.valid())
+  {
+    return -1;
+  }
+  uint32_t elemIndex = reader.find_element(name);
+  if (elemIndex == miniply::kInvalidIndex)
+    return 0;
+  return reader.get_element(elemIndex)->count;
+}
+
 extern "C"
 {
   int ply_count_vertex(const char *filename)
   {
     miniply::PLYReader reader(filename);
-    if (!reader.valid())
-    {
-      return -1;
-    }
-    uint32_t elemIndex =
-        reader.find_element(miniply::kPLYVertexElement);
-    if (elemIndex == miniply::kInvalidIndex)
-      return 0;
-    return reader.get_element(elemIndex)->count;
+    return p_count_element(reader, miniply::kPLYVertexElement);
   }
   int ply_count_face(const char *filename)
   {
     miniply::PLYReader reader(filename);
-    if (!reader.valid())
-    {
-      return -1;
-    }
-    uint32_t elemIndex =
-        reader.find_element(miniply::kPLYFaceElement);
-    if (elemIndex == miniply::kInvalidIndex)
-      return 0;
-    return reader.get_element(elemIndex)->count;
+    return p_count_element(reader, miniply::kPLYFaceElement);
   }
   // Wrapper implementation
   int ply_pointcloud_loader(const char    *filename,
                             float         *pos,
                             unsigned char *rgb)
   {
-    return p_vert_col_ply_loader(filename, pos, rgb) ? 1 : 0;
+    miniply::PLYReader reader(filename);
+    return p_vert_col_ply_loader(reader, pos, rgb) ? 1 : 0;
   }
   int ply_mesh_loader(const char *filename, float *pos, int *indices)
   {
-    return p_pos_indices_ply_loader(filename, pos, indices) ? 1 : 0;
+    miniply::PLYReader reader(filename);
+    return p_pos_indices_ply_loader(reader, pos, indices) ? 1 : 0;
+  }
+
+  ply_reader_t *ply_reader_open(const char *filename)
+  {
+    ply_reader_t *r = new ply_reader_t(filename);
+    if (!r->reader.valid())
+    {
+      delete r;
+      return NULL;
+    }
+    return r;
+  }
+  int ply_reader_count_vertex(ply_reader_t *r)
+  {
+    return p_count_element(r->reader, miniply::kPLYVertexElement);
+  }
+  int ply_reader_count_face(ply_reader_t *r)
+  {
+    return p_count_element(r->reader, miniply::kPLYFaceElement);
+  }
+  int ply_reader_load_pointcloud(ply_reader_t  *r,
+                                 float         *pos,
+                                 unsigned char *rgb)
+  {
+    return p_vert_col_ply_loader(r->reader, pos, rgb) ? 1 : 0;
+  }
+  int ply_reader_load_mesh(ply_reader_t *r, float *pos, int *indices)
+  {
+    return p_pos_indices_ply_loader(r->reader, pos, indices) ? 1 : 0;
+  }
+  int ply_reader_read_points(ply_reader_t  *r,
+                             size_t         max_points,
+                             float         *pos,
+                             unsigned char *rgb)
+  {
+    return p_vert_col_ply_rows(r->reader, max_points, pos, rgb);
+  }
+  int ply_reader_count_comment(ply_reader_t *r)
+  {
+    return static_cast<int>(r->reader.num_comments());
+  }
+  const char *ply_reader_comment(ply_reader_t *r, int index)
+  {
+    return r->reader.get_comment(static_cast<uint32_t>(index));
+  }
+  void ply_reader_close(ply_reader_t *r)
+  {
+    delete r;
   }
 }
@@ -1,5 +1,104 @@
 #include <pcprep/pointcloud.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Decimal literals whose float is easy to get wrong: the first ones
+// are halfway cases that round twice when parsed as a double first.
+static const char *literals_g[] = {"9.000000476837159",
+                                   "16777217.5",
+                                   "1.00000005960464477539",
+                                   "0.1",
+                                   "-325.75e-2",
+                                   "1.5e-7"};
+
+// Writes an ASCII cloud with the literals of `literals_g` as
+// coordinates, loads it back and compares them with strtof.
+static int check_ascii_floats(void)
+{
+  const char  *path  = "ascii_floats.ply";
+  size_t       count = sizeof(literals_g) / sizeof(literals_g[0]);
+  pointcloud_t pc    = {0};
+  FILE        *file  = fopen(path, "w");
+  int          ret   = 0;
+  if (!file)
+    return 1;
+  fprintf(file,
+          "ply\nformat ascii 1.0\nelement vertex %zu\n"
+          "property float x\nproperty float y\nproperty float z\n"
+          "property uchar red\nproperty uchar green\n"
+          "property uchar blue\nend_header\n",
+          count);
+  for (size_t i = 0; i < count; i++)
+    fprintf(file, "%s %s %s 1 2 3\n", literals_g[i], "0", "0");
+  fclose(file);
+
+  if (!pointcloud_load(&pc, path) || pc.size != count)
+    return 1;
+  for (size_t i = 0; i < count; i++)
+  {
+    float want = strtof(literals_g[i], NULL);
+    if (memcmp(&pc.pos[3 * i], &want, sizeof(want)) != 0)
+    {
+      printf("%s: %.9g, expected %.9g\n",
+             literals_g[i],
+             pc.pos[3 * i],
+             want);
+      ret = 1;
+    }
+  }
+  pointcloud_free(&pc);
+  return ret;
+}
+
+// Loads an ASCII cloud with unsigned coordinates above INT32_MAX.
+static int check_ascii_uints(void)
+{
+  const char  *path = "ascii_uints.ply";
+  pointcloud_t pc   = {0};
+  FILE        *file = fopen(path, "w");
+  int          ret  = 0;
+  if (!file)
+    return 1;
+  fprintf(file,
+          "ply\nformat ascii 1.0\nelement vertex 2\n"
+          "property uint x\nproperty uint y\nproperty uint z\n"
+          "property uchar red\nproperty uchar green\n"
+          "property uchar blue\nend_header\n"
+          "4294967295 3000000000 7 1 2 3\n"
+          "2147483648 0 +12 1 2 3\n");
+  fclose(file);
+
+  if (!pointcloud_load(&pc, path) || pc.size != 2 ||
+      (double)pc.pos[0] < 4.29e9 || (double)pc.pos[1] < 2.99e9 ||
+      (double)pc.pos[3] < 2.14e9 || (int)pc.pos[5] != 12)
+    ret = 1;
+  pointcloud_free(&pc);
+  return ret;
+}
+
+// Saves the positions of `path` alone as PCB and loads them back,
+// with black colors; PLY can't hold them without colors.
+static int check_pos_only(const char *path)
+{
+  pointcloud_t pc   = {0};
+  pointcloud_t back = {0};
+  int          ret  = 0;
+  if (!pointcloud_load_props(&pc, path, PCP_PROP_POS) || pc.rgb ||
+      pointcloud_write_quantized(pc, "pos_only.ply", 1, 16) >= 0 ||
+      pointcloud_save_pcb(pc, "pos_only.pcb") < 0 ||
+      !pointcloud_load(&back, "pos_only.pcb") ||
+      back.size != pc.size ||
+      memcmp(back.pos, pc.pos, sizeof(float) * 3 * pc.size) != 0)
+    ret = 1;
+  for (size_t i = 0; ret == 0 && i < 3 * back.size; i++)
+    if (back.rgb[i] != 0)
+      ret = 1;
+  pointcloud_free(&back);
+  pointcloud_free(&pc);
+  return ret;
+}
+
 int main(int argc, char *argv[])
 {
   pointcloud_t pc;
@@ -13,4 +112,6 @@ int main(int argc, char *argv[])
 
   pointcloud_write(pc, "out_msh.ply", 1);
   pointcloud_free(&pc);
+  return check_ascii_floats() || check_ascii_uints() ||
+         check_pos_only(argv[1]);
 }
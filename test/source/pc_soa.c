@@ -0,0 +1,87 @@
+#include <pcprep/pointcloud.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+int main(int argc, char *argv[])
+{
+  pointcloud_t     pc    = {0};
+  pointcloud_t     back  = {0};
+  pointcloud_soa_t soa   = {0};
+  pointcloud_soa_t ndc   = {0};
+  vec3f_t          n     = {3, 2, 4};
+  vec3f_t          min   = {0, 0, 0};
+  vec3f_t          max   = {0, 0, 0};
+  aabb_t           aabb  = {{0, 0, 0}, {0, 0, 0}};
+  int             *ids   = NULL;
+  // column-major perspective-like matrix, w = 800 - z
+  float            mvp[] = {
+      1.2f, 0, 0, 0, 0, 1.5f, 0, 0, 0, 0, -1, -1, 0, -300, 500, 800};
+
+  if (!pointcloud_load(&pc, argv[1]) || pc.size == 0)
+    return 1;
+  if (pointcloud_to_soa(pc, &soa) < 0 ||
+      (uintptr_t)soa.x % (PCP_SOA_WIDTH * sizeof(float)) != 0 ||
+      pointcloud_soa_init(&ndc, pc.size) < 0)
+    return 1;
+
+  pointcloud_min(pc, &min);
+  pointcloud_max(pc, &max);
+  pointcloud_soa_bounds(soa, &aabb);
+  if (memcmp(&aabb.min, &min, sizeof(min)) != 0 ||
+      memcmp(&aabb.max, &max, sizeof(max)) != 0)
+    return 1;
+
+  // a box smaller than the cloud, so that some points are outside
+  aabb.max = vec3f_mul_scalar(vec3f_add(aabb.min, aabb.max), 0.75f);
+  ids      = (int *)malloc(sizeof(int) * pc.size);
+  pointcloud_soa_tile_ids(soa, n, aabb, ids);
+  pointcloud_soa_project(soa, mvp, &ndc);
+  for (size_t i = 0; i < pc.size; i++)
+  {
+    vec3f_t p = {pc.pos[3 * i], pc.pos[3 * i + 1], pc.pos[3 * i + 2]};
+    vec3f_t q = vec3f_mvp_mul(p, mvp);
+    if (ids[i] != get_tile_id(n, aabb.min, aabb.max, p) ||
+        memcmp(&q.x, &ndc.x[i], sizeof(float)) != 0 ||
+        memcmp(&q.y, &ndc.y[i], sizeof(float)) != 0 ||
+        memcmp(&q.z, &ndc.z[i], sizeof(float)) != 0)
+      return 1;
+  }
+
+  if (pointcloud_from_soa(soa, &back) < 0 || back.size != pc.size ||
+      memcmp(back.pos, pc.pos, sizeof(float) * 3 * pc.size) != 0 ||
+      memcmp(back.rgb, pc.rgb, 3 * pc.size) != 0)
+    return 1;
+
+  // the fused bounds are cached, and found again once invalidated
+  if (pointcloud_bounds(&pc, &aabb) < 0 || !pc.has_bounds ||
+      memcmp(&aabb.min, &min, sizeof(min)) != 0 ||
+      memcmp(&aabb.max, &max, sizeof(max)) != 0)
+    return 1;
+  pc.pos[0] = max.x + 1.0f;
+  pointcloud_invalidate_bounds(&pc);
+  if (pointcloud_bounds(&pc, &aabb) < 0 ||
+      memcmp(&aabb.max.x, &pc.pos[0], sizeof(float)) != 0)
+    return 1;
+
+  // pixels are counted per tile of the actual bounds, not the cache
+  float        eye[16]   = {1, 0, 0, 0, 0, 1, 0, 0,
+                            0, 0, 1, 0, 0, 0, 0, 1};
+  float        two[6]    = {-0.5f, 0, 0.5f, 0.5f, 0, 0.5f};
+  pointcloud_t pair      = {two, NULL, 2};
+  int          pixels[2] = {0, 0};
+
+  pair.has_bounds = 1;
+  pair.bounds     = (aabb_t){{-0.5f, 0, 0.5f}, {-0.4f, 0, 0.5f}};
+  if (pointcloud_count_pixel_per_tile(
+          pair, 2, 1, 1, 4, 4, eye, pixels) < 0 ||
+      pixels[0] != 1 || pixels[1] != 1)
+    return 1;
+  printf("%zu\n", pc.size);
+
+  free(ids);
+  pointcloud_free(&back);
+  pointcloud_soa_free(&ndc);
+  pointcloud_soa_free(&soa);
+  pointcloud_free(&pc);
+  return 0;
+}
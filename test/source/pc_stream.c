@@ -0,0 +1,35 @@
+#include <pcprep/pointcloud.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+int main(int argc, char *argv[])
+{
+  pointcloud_t pc         = {0};
+  pointcloud_t chunk      = {0};
+  size_t       max_points = (size_t)atoi(argv[2]);
+  size_t       read       = 0;
+  int          n          = 0;
+
+  if (!pointcloud_load(&pc, argv[1]))
+    return 1;
+  pointcloud_stream_t *stream = pointcloud_stream_open(argv[1]);
+  if (stream == NULL || pointcloud_stream_size(stream) != pc.size)
+    return 1;
+  while ((n = pointcloud_stream_next_chunk(
+              stream, max_points, &chunk)) > 0)
+  {
+    if (read + chunk.size > pc.size ||
+        memcmp(chunk.pos,
+               pc.pos + read * 3,
+               sizeof(float) * 3 * chunk.size) != 0 ||
+        memcmp(chunk.rgb, pc.rgb + read * 3, 3 * chunk.size) != 0)
+      return 1;
+    read += chunk.size;
+  }
+  printf("%zu\n", read);
+
+  pointcloud_stream_close(stream);
+  pointcloud_free(&chunk);
+  pointcloud_free(&pc);
+  return n < 0 || read != pc.size;
+}
@@ -1,41 +1,34 @@
+#include <pcprep/core.h>
 #include <pcprep/pointcloud.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
-void samplef(int *input, int input_size, int *output, int output_size)
+// Whether `k` indices of [0, n) are increasing, hence distinct.
+static int indices_valid(const size_t *index, size_t k, size_t n)
 {
-  if (output_size > input_size)
-  {
-    fprintf(stderr,
-            "Error: output_size cannot be larger than input_size.\n");
-    return;
-  }
-
-  // Create an array to keep track of selected indices
-  int *selected = calloc(input_size, sizeof(int));
-  if (!selected)
-  {
-    fprintf(stderr, "Memory allocation failed.\n");
-    return;
-  }
-
-  srand((unsigned int)time(NULL)); // Seed the random number generator
-
-  int selected_count = 0;
-  while (selected_count < output_size)
-  {
-    int index = rand() % input_size;
+  for (size_t i = 0; i < k; i++)
+    if (index[i] >= n || (i > 0 && index[i] <= index[i - 1]))
+      return 0;
+  return 1;
+}
 
-    // Ensure no duplicates
-    if (!selected[index])
-    {
-      selected[index]          = 1;
-      output[selected_count++] = input[index];
-    }
-  }
+static float dist2(const float *a, const float *b)
+{
+  float dx = a[0] - b[0];
+  float dy = a[1] - b[1];
+  float dz = a[2] - b[2];
+  return dx * dx + dy * dy + dz * dz;
+}
 
-  free(selected);
+// Largest squared distance from `p` to a point of `pc`.
+static float farthest(pointcloud_t pc, const float *p)
+{
+  float d = 0;
+  for (size_t i = 0; i < pc.size; i++)
+    if (dist2(p, pc.pos + 3 * i) > d)
+      d = dist2(p, pc.pos + 3 * i);
+  return d;
 }
 
 int main(int argc, char *argv[])
@@ -50,37 +43,66 @@ int main(int argc, char *argv[])
 
   pointcloud_t pc           = {0};
   pointcloud_t sub          = {0};
+  pointcloud_t again        = {0};
   float        NvertPercent = 0;
-  int          subVerts     = 0;
-  int         *index_arr    = NULL;
-  int         *sample       = NULL;
+  float        d            = 0;
+  float        far          = 0;
+  size_t       subVerts     = 0;
+  size_t      *index        = NULL;
+  size_t       n            = 0;
 
-  pointcloud_load(&pc, argv[1]);
+  if (!pointcloud_load(&pc, argv[1]) || pc.size == 0)
+    return 1;
   NvertPercent = atof(argv[2]);
-  subVerts     = (int)(pc.size * NvertPercent);
+  subVerts     = (size_t)(pc.size * NvertPercent);
 
-  pointcloud_init(&sub, subVerts);
-  index_arr = (int *)malloc(sizeof(int) * pc.size);
-  sample    = (int *)malloc(subVerts * sizeof(int));
-  srand((unsigned int)time(NULL)); // Seed the random number generator
+  // the same seed keeps the same points
+  if (pointcloud_sample(pc, NvertPercent, 0, 7, &sub) !=
+          (int)subVerts ||
+      pointcloud_sample(pc, NvertPercent, 0, 7, &again) !=
+          (int)subVerts ||
+      memcmp(sub.pos, again.pos, sizeof(float) * 3 * subVerts) != 0 ||
+      memcmp(sub.rgb, again.rgb, 3 * subVerts) != 0)
+    return 1;
+  pointcloud_free(&again);
 
-  for (int i = 0; i < pc.size; i++)
-    index_arr[i] = i;
+  // farthest point sampling: the second pick is the point farthest
+  // from the first
+  if (pointcloud_sample(pc, 0.001f, PCP_SAMPLE_RULE_FPS, 7, &again) !=
+          (int)(pc.size * 0.001f) ||
+      again.size < 2)
+    return 1;
+  d   = dist2(again.pos, again.pos + 3);
+  far = farthest(pc, again.pos);
+  if (memcmp(&d, &far, sizeof(float)) != 0)
+    return 1;
+  pointcloud_free(&again);
 
-  samplef(index_arr, pc.size, sample, subVerts);
+  // Poisson disk sampling: no two points kept nearer than the radius
+  if (pointcloud_sample_poisson(pc, 50.0f, 7, &again) <= 0)
+    return 1;
+  for (size_t i = 0; i < again.size; i++)
+    for (size_t j = i + 1; j < again.size; j++)
+      if (dist2(again.pos + 3 * i, again.pos + 3 * j) < 50.0f * 50.0f)
+        return 1;
+  pointcloud_free(&again);
+
+  // both Floyd's algorithm and sequential skips, and every index
+  n     = pc.size;
+  index = (size_t *)malloc(sizeof(size_t) * n);
+  if (sample_indices(3, n, n / 100, index) != (int)(n / 100) ||
+      !indices_valid(index, n / 100, n) ||
+      sample_indices(3, n, n / 2, index) != (int)(n / 2) ||
+      !indices_valid(index, n / 2, n) ||
+      sample_indices(3, n, n, index) != (int)n ||
+      !indices_valid(index, n, n) ||
+      sample_indices(3, n, n + 1, index) >= 0)
+    return 1;
+  free(index);
 
-  for (int i = 0; i < subVerts; i++)
-  {
-    for (int j = 0; j < 3; j++)
-    {
-      sub.pos[i * 3 + j] = pc.pos[sample[i] * 3 + j];
-      sub.rgb[i * 3 + j] = pc.rgb[sample[i] * 3 + j];
-    }
-  }
   pointcloud_write(sub, argv[3], 1);
 
   pointcloud_free(&pc);
   pointcloud_free(&sub);
-  free(index_arr);
-  free(sample);
+  return 0;
 }
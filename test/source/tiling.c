@@ -1,6 +1,7 @@
 #include <pcprep/pointcloud.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -25,8 +26,12 @@ int main(int argc, char *argv[])
   char          out_file_name[1024];
   pointcloud_t  pc         = {0};
   pointcloud_t *tiles      = NULL;
+  pointcloud_t *views      = NULL;
   struct stat   st         = {0};
   int           tile_count = 0;
+  int           ret        = 0;
+
+  pointcloud_arena_t arena;
 
   pointcloud_load(&pc, input_file_path);
   tile_count = pointcloud_tile(pc, n_x, n_y, n_z, &tiles);
@@ -50,8 +55,87 @@ int main(int argc, char *argv[])
     pointcloud_write(tiles[t], out_file_name, isBinary);
   }
 
+  // Tiling into an arena, twice to reuse it, gives the same tiles.
+  pointcloud_arena_init(&arena, 0);
+  for (int round = 0; round < 2; round++)
+  {
+    if (pointcloud_tile_arena(pc, n_x, n_y, n_z, &arena, &views) !=
+        tile_count)
+      ret = 1;
+    for (int t = 0; t < tile_count && ret == 0; t++)
+    {
+      if (views[t].size != tiles[t].size ||
+          memcmp(views[t].pos,
+                 tiles[t].pos,
+                 sizeof(float) * 3 * tiles[t].size) != 0 ||
+          memcmp(views[t].rgb, tiles[t].rgb, 3 * tiles[t].size) != 0)
+      {
+        printf("Arena tile %d differs\n", t);
+        ret = 1;
+      }
+    }
+    for (int i = 0; i < tile_count; i++)
+      pointcloud_free(&views[i]);
+    free(views);
+  }
+  pointcloud_arena_free(&arena);
+
+  // Partitioning in place gives tiles of the same points, in another
+  // order.
+  aabb_t *aabbs = (aabb_t *)malloc(sizeof(aabb_t) * tile_count);
+  if (pointcloud_partition(&pc, n_x, n_y, n_z, &views, aabbs) !=
+      tile_count)
+    ret = 1;
+  for (int t = 0; t < tile_count && ret == 0; t++)
+  {
+    vec3f_t min = {0, 0, 0};
+    vec3f_t max = {0, 0, 0};
+    if (tiles[t].size > 0)
+    {
+      pointcloud_min(tiles[t], &min);
+      pointcloud_max(tiles[t], &max);
+    }
+    if (views[t].size != tiles[t].size ||
+        memcmp(&aabbs[t].min, &min, sizeof(vec3f_t)) != 0 ||
+        memcmp(&aabbs[t].max, &max, sizeof(vec3f_t)) != 0)
+    {
+      printf("Partition tile %d differs\n", t);
+      ret = 1;
+    }
+  }
+  for (int i = 0; i < tile_count; i++)
+    pointcloud_free(&views[i]);
+  free(views);
+  free(aabbs);
+
+  // An empty tile doesn't take the colors away from a merge.
+  pointcloud_t with_empty[2] = {tiles[0], {0}};
+  pointcloud_t merged        = {0};
+  if (pointcloud_merge(with_empty, 2, &merged) < 0 ||
+      merged.size != tiles[0].size || !merged.rgb)
+    ret = 1;
+  pointcloud_free(&merged);
+
+  // Moving a point out of the cached bounds directly is still seen.
+  pointcloud_t moved = pc;
+  vec3f_t      max   = {0, 0, 0};
+  size_t       total = 0;
+  moved.pos[0] += 1e6f;
+  moved.pos[1] -= 1e6f;
+  pointcloud_max(moved, &max);
+  if (memcmp(&max.x, moved.pos, sizeof(float)) != 0 ||
+      pointcloud_partition(&moved, n_x, n_y, n_z, &views, NULL) !=
+          tile_count)
+    ret = 1;
+  for (int t = 0; t < tile_count && ret == 0; t++)
+    total += views[t].size;
+  if (total != pc.size)
+    ret = 1;
+  free(views);
+
   pointcloud_free(&pc);
   for (int i = 0; i < tile_count; i++)
     pointcloud_free(&tiles[i]);
   free(tiles);
+  return ret;
 }